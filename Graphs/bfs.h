@@ -0,0 +1,254 @@
+#pragma once
+
+#include "graph.h"
+#include <threadpool.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Breadth first search over a CsrGraph for hop distances, -1 for the nodes the source does not reach.
+namespace bfs
+{
+	enum Direction
+	{
+		// Beamer's heuristic: top-down while the frontier is small, bottom-up once it is growing and its edges
+		// outnumber a fifteenth (Alpha) of the unexplored ones, back to top-down once it is shrinking and holds
+		// under 1/18 (Beta) of the nodes
+		DirectionOptimizing,
+		// the frontier's edges claim their unvisited targets
+		TopDown,
+		// every unvisited node looks for a parent in the frontier among its incoming edges, and stops at the first
+		BottomUp
+	};
+
+	// Level synchronous with an atomic bitmap for the visited set. Top-down levels keep the frontier as a list of
+	// nodes and only touch the frontier's edges, bottom-up levels keep it as a bitmap and go over all unvisited
+	// nodes; the frontier changes form when the direction does. Levels are split over ThreadPool::shared(), by
+	// frontier nodes top-down and by bitmap words bottom-up. transposed holds the incoming edges for the bottom-up
+	// steps, an undirected graph can pass itself.
+	void distances(const CsrGraph& g, const CsrGraph& transposed, int source, std::vector<int>& outDistance, Direction direction = DirectionOptimizing);
+	// Transposes g first, for a single search.
+	void distances(const CsrGraph& g, int source, std::vector<int>& outDistance, Direction direction = DirectionOptimizing);
+
+	// ---- Inline implementation ----
+
+	// index of the lowest set bit of x != 0, by de Bruijn multiplication since there is no portable intrinsic
+	inline int lowestBit(uint64_t x)
+	{
+		static const int table[64] =
+		{
+			 0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+			62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+			63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+			46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6
+		};
+		return table[((x & (~x + 1)) * 0x03f79d71b4cb0a89ULL) >> 58];
+	}
+
+	inline void distances(const CsrGraph& g, const CsrGraph& transposed, int source, std::vector<int>& outDistance, Direction direction)
+	{
+		const size_t Alpha = 15;
+		const size_t Beta = 18;
+		// frontier nodes per chunk top-down, bitmap words per chunk bottom-up
+		const size_t nodeGrain = 1024;
+		const size_t wordGrain = 64;
+
+		size_t n = g.size();
+		size_t words = (n + 63) / 64;
+		outDistance.assign(n, -1);
+		if (n == 0)
+		{
+			return;
+		}
+
+		std::vector<std::atomic<uint64_t> > visited(words);
+		for (size_t w = 0; w < words; w++)
+		{
+			visited[w].store(0, std::memory_order_relaxed);
+		}
+		// the bits past the last node count as visited, so that bottom-up steps never look at them
+		if (n % 64)
+		{
+			visited[words - 1].store(~0ULL << (n % 64), std::memory_order_relaxed);
+		}
+		visited[source / 64].fetch_or(1ULL << (source % 64));
+		outDistance[source] = 0;
+
+		// every node enters the frontier once, so the lists never hold more than n
+		std::vector<int> queue(n), nextQueue(n);
+		std::vector<uint64_t> frontier, next;
+		queue[0] = source;
+		size_t queueSize = 1;
+
+		const size_t* offsets = g.edgeOffsets();
+		const int* targets = g.edgeTargets();
+		const size_t* inOffsets = transposed.edgeOffsets();
+		const int* sources = transposed.edgeTargets();
+		size_t frontierNodes = 1, previousNodes = 0;
+		size_t frontierEdges = g.degree(source);
+		size_t unexploredEdges = g.edgeCount() - frontierEdges;
+		bool bottomUp = false;
+		ThreadPool& pool = ThreadPool::shared();
+
+		for (int level = 1; frontierNodes > 0; level++)
+		{
+			bool wasBottomUp = bottomUp;
+			if (direction == BottomUp)
+			{
+				bottomUp = true;
+			}
+			else if (direction == DirectionOptimizing)
+			{
+				// the trend keeps the level right after a switch from switching back
+				if (!bottomUp && frontierEdges > unexploredEdges / Alpha && frontierNodes > previousNodes)
+				{
+					bottomUp = true;
+				}
+				else if (bottomUp && frontierNodes < n / Beta && frontierNodes < previousNodes)
+				{
+					bottomUp = false;
+				}
+			}
+
+			if (bottomUp && !wasBottomUp)
+			{
+				frontier.assign(words, 0);
+				next.resize(words);
+				for (size_t i = 0; i < queueSize; i++)
+				{
+					frontier[queue[i] / 64] |= 1ULL << (queue[i] % 64);
+				}
+			}
+			else if (!bottomUp && wasBottomUp)
+			{
+				queueSize = 0;
+				for (size_t w = 0; w < words; w++)
+				{
+					for (uint64_t bits = frontier[w]; bits; bits &= bits - 1)
+					{
+						queue[queueSize++] = (int) (w * 64 + lowestBit(bits));
+					}
+				}
+			}
+
+			std::atomic<size_t> nextNodes(0), nextEdges(0);
+			bool concurrent = false;
+			auto topDown = [&](size_t first, size_t last)
+			{
+				size_t nodes = 0, edges = 0;
+				for (size_t i = first; i < last; i++)
+				{
+					int v = queue[i];
+					for (size_t e = offsets[v]; e < offsets[v + 1]; e++)
+					{
+						int t = targets[e];
+						uint64_t bit = 1ULL << (t % 64);
+						// a plain load first, most targets are visited already on dense levels
+						uint64_t word = visited[t / 64].load(std::memory_order_relaxed);
+						if (word & bit)
+						{
+							continue;
+						}
+						// a level run by one thread needs no locked instructions to claim the target and its slot
+						if (concurrent)
+						{
+							if (visited[t / 64].fetch_or(bit) & bit)
+							{
+								continue;
+							}
+							nextQueue[nextNodes.fetch_add(1, std::memory_order_relaxed)] = t;
+						}
+						else
+						{
+							visited[t / 64].store(word | bit, std::memory_order_relaxed);
+							nextQueue[nodes++] = t;
+						}
+						outDistance[t] = level;
+						edges += offsets[t + 1] - offsets[t];
+					}
+				}
+				nextNodes += nodes;
+				nextEdges += edges;
+			};
+			auto bottomUpStep = [&](size_t first, size_t last)
+			{
+				// the words of this range belong to this chunk alone
+				size_t nodes = 0, edges = 0;
+				for (size_t w = first; w < last; w++)
+				{
+					uint64_t found = 0;
+					for (uint64_t bits = ~visited[w].load(std::memory_order_relaxed); bits; bits &= bits - 1)
+					{
+						int v = (int) (w * 64 + lowestBit(bits));
+						for (size_t e = inOffsets[v]; e < inOffsets[v + 1]; e++)
+						{
+							int u = sources[e];
+							if (frontier[u / 64] & (1ULL << (u % 64)))
+							{
+								outDistance[v] = level;
+								found |= 1ULL << (v % 64);
+								nodes++;
+								edges += offsets[v + 1] - offsets[v];
+								break;
+							}
+						}
+					}
+					if (found)
+					{
+						visited[w].fetch_or(found, std::memory_order_relaxed);
+					}
+					next[w] = found;
+				}
+				nextNodes += nodes;
+				nextEdges += edges;
+			};
+
+			if (bottomUp)
+			{
+				if (pool.size() > 1 && words > wordGrain)
+				{
+					pool.parallelFor(0, words, wordGrain, bottomUpStep);
+				}
+				else
+				{
+					bottomUpStep(0, words);
+				}
+				frontier.swap(next);
+			}
+			else
+			{
+				if (pool.size() > 1 && queueSize > nodeGrain)
+				{
+					concurrent = true;
+					pool.parallelFor(0, queueSize, nodeGrain, topDown);
+				}
+				else
+				{
+					topDown(0, queueSize);
+				}
+				queue.swap(nextQueue);
+				queueSize = nextNodes;
+			}
+			previousNodes = frontierNodes;
+			frontierNodes = nextNodes;
+			frontierEdges = nextEdges;
+			unexploredEdges -= std::min(unexploredEdges, frontierEdges);
+		}
+	}
+
+	inline void distances(const CsrGraph& g, int source, std::vector<int>& outDistance, Direction direction)
+	{
+		CsrGraph transposed;
+		if (direction != TopDown)
+		{
+			g.transpose(transposed);
+		}
+		else
+		{
+			// top-down steps never read the incoming edges, an empty graph of the same size will do
+			transposed = CsrGraph(g.size(), 0, 0);
+		}
+		distances(g, transposed, source, outDistance, direction);
+	}
+}
@@ -0,0 +1,583 @@
+#include "graph.h"
+#include "shortestpath.h"
+#include "bfs.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <limits>
+
+// Checks that flow is a feasible flow of value 'value' in g, and a maximum one: the nodes reachable from the
+// source in the residual network form a cut whose capacity equals the value.
+void checkMaxFlow(const Graph& g, const Graph& flow, int source, int sink, double value)
+{
+	size_t n = g.size();
+	std::vector<double> balance(n, 0.0);
+	std::vector<std::vector<int>> residual(n);
+	for (size_t v = 0; v < n; v++)
+	{
+		const std::vector<Graph::Edge>& edges = g.edges((int) v);
+		const std::vector<Graph::Edge>& flows = flow.edges((int) v);
+		assert(edges.size() == flows.size());
+		for (size_t j = 0; j < edges.size(); j++)
+		{
+			double f = flows[j].cost;
+			assert(flows[j].from == edges[j].from && flows[j].to == edges[j].to);
+			assert(f >= -1e-9 && f <= edges[j].cost + 1e-9);
+			balance[edges[j].from] -= f;
+			balance[edges[j].to] += f;
+			if (f < edges[j].cost - 1e-9) residual[edges[j].from].push_back(edges[j].to);
+			if (f > 1e-9) residual[edges[j].to].push_back(edges[j].from);
+		}
+	}
+	for (size_t v = 0; v < n; v++)
+	{
+		double expected = ((int) v == source) ? -value : ((int) v == sink) ? value : 0.0;
+		assert(std::abs(balance[v] - expected) < 1e-6);
+	}
+
+	std::vector<bool> reached(n, false);
+	std::vector<int> stack(1, source);
+	reached[source] = true;
+	while (!stack.empty())
+	{
+		int v = stack.back();
+		stack.pop_back();
+		for (size_t j = 0; j < residual[v].size(); j++)
+		{
+			int w = residual[v][j];
+			if (!reached[w])
+			{
+				reached[w] = true;
+				stack.push_back(w);
+			}
+		}
+	}
+	assert(!reached[sink] || source == sink);
+	double cut = 0.0;
+	for (size_t v = 0; v < n; v++)
+	{
+		const std::vector<Graph::Edge>& edges = g.edges((int) v);
+		for (size_t j = 0; j < edges.size(); j++)
+		{
+			if (reached[edges[j].from] && !reached[edges[j].to]) cut += edges[j].cost;
+		}
+	}
+	assert(source == sink || std::abs(cut - value) < 1e-6);
+}
+
+// two draws since RAND_MAX may be 32767
+size_t bigRand()
+{
+	return (size_t) std::rand() * RAND_MAX + std::rand();
+}
+
+// width x height grid with edges both ways between neighbours and random lengths, about a tenth of the
+// streets missing, the shape of a road network
+CsrGraph roadGraph(int width, int height)
+{
+	std::vector<Graph::Edge> edges;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int v = y * width + x;
+			for (int direction = 0; direction < 2; direction++)
+			{
+				int w = (direction == 0) ? v + 1 : v + width;
+				if ((direction == 0 && x + 1 == width) || (direction == 1 && y + 1 == height) || std::rand() % 10 == 0)
+				{
+					continue;
+				}
+				double length = 1 + std::rand() % 100;
+				Graph::Edge forward = { v, w, length }, backward = { w, v, length };
+				edges.push_back(forward);
+				edges.push_back(backward);
+			}
+		}
+	}
+	return CsrGraph(width * height, edges.data(), edges.size());
+}
+
+// R-MAT generator: every edge picks a quadrant of the adjacency matrix per bit with skewed probabilities,
+// which gives the power-law degrees and small diameter of social and web graphs
+CsrGraph powerLawGraph(int scale, size_t edgesPerNode)
+{
+	size_t n = (size_t) 1 << scale;
+	std::vector<Graph::Edge> edges(n * edgesPerNode);
+	for (size_t e = 0; e < edges.size(); e++)
+	{
+		size_t from = 0, to = 0;
+		for (int bit = 0; bit < scale; bit++)
+		{
+			// quadrant probabilities 0.57, 0.19, 0.19 and 0.05
+			int r = std::rand() % 100;
+			bool down = r >= 76;
+			bool right = (r >= 57 && r < 76) || r >= 95;
+			from = 2 * from + (down ? 1 : 0);
+			to = 2 * to + (right ? 1 : 0);
+		}
+		Graph::Edge edge = { (int) from, (int) to, (double) (1 + std::rand() % 100) };
+		edges[e] = edge;
+	}
+	return CsrGraph(n, edges.data(), edges.size());
+}
+
+void testMaxFlow()
+{
+	const Graph::MaxFlowAlgorithm algorithms[] = { Graph::Dinic, Graph::PushRelabel };
+
+	// the textbook network with a maximum flow of 23
+	Graph g(6);
+	g.add(0, 1, 16); g.add(0, 2, 13);
+	g.add(1, 3, 12); g.add(2, 1, 4);
+	g.add(2, 4, 14); g.add(3, 2, 9);
+	g.add(3, 5, 20); g.add(4, 3, 7);
+	g.add(4, 5, 4);
+	for (size_t a = 0; a < 2; a++)
+	{
+		Graph flow(0);
+		double value = g.maxFlow(0, 5, flow, algorithms[a]);
+		assert(value == 23.0);
+		checkMaxFlow(g, flow, 0, 5, value);
+
+		// nothing gets back to the source
+		value = g.maxFlow(5, 0, flow, algorithms[a]);
+		assert(value == 0.0);
+		checkMaxFlow(g, flow, 5, 0, value);
+	}
+
+	// random graphs with integer capacities, parallel edges, self loops and dead ends included
+	for (int round = 0; round < 200; round++)
+	{
+		int n = 2 + std::rand() % 40;
+		int m = std::rand() % (n * 6);
+		Graph r(n);
+		for (int e = 0; e < m; e++)
+		{
+			r.add(std::rand() % n, std::rand() % n, std::rand() % 20);
+		}
+		if (round % 2)
+		{
+			r.addUndirected(0, n - 1, 1);
+		}
+
+		double values[2];
+		for (size_t a = 0; a < 2; a++)
+		{
+			Graph flow(0);
+			values[a] = r.maxFlow(0, n - 1, flow, algorithms[a]);
+			checkMaxFlow(r, flow, 0, n - 1, values[a]);
+		}
+		assert(values[0] == values[1]);
+	}
+}
+
+void testCsrGraph()
+{
+	// the same random graph from a Graph and from shuffled edges
+	const int n = 300;
+	Graph g(n);
+	std::vector<Graph::Edge> edges;
+	for (int e = 0; e < 3000; e++)
+	{
+		Graph::Edge edge = { std::rand() % n, std::rand() % n, (double) (std::rand() % 50) };
+		g.add(edge.from, edge.to, edge.cost);
+		edges.push_back(edge);
+	}
+	for (size_t e = edges.size() - 1; e > 0; e--)
+	{
+		std::swap(edges[std::rand() % (e + 1)], edges[e]);
+	}
+
+	CsrGraph a(g), b(n, edges.data(), edges.size());
+	assert(a.size() == (size_t) n && b.size() == (size_t) n && a.edgeCount() == 3000 && b.edgeCount() == 3000);
+	size_t totalDegree = 0;
+	for (int v = 0; v < n; v++)
+	{
+		const std::vector<Graph::Edge>& out = g.edges(v);
+		assert(a.degree(v) == out.size() && b.degree(v) == out.size());
+		std::vector<std::pair<int, double> > x, y;
+		for (size_t j = 0; j < out.size(); j++)
+		{
+			assert(a.target(a.begin(v) + j) == out[j].to && a.weight(a.begin(v) + j) == out[j].cost);
+			x.push_back(std::make_pair(out[j].to, out[j].cost));
+			y.push_back(std::make_pair(b.target(b.begin(v) + j), b.weight(b.begin(v) + j)));
+		}
+		std::sort(x.begin(), x.end());
+		std::sort(y.begin(), y.end());
+		assert(x == y);
+		totalDegree += a.degree(v);
+	}
+	assert(totalDegree == a.edgeCount() && a.edgeOffsets()[n] == a.edgeCount());
+
+	// the transposed graph has the edge u -> v for every v -> u, transposing twice gives the edges back ordered by target
+	CsrGraph t, tt;
+	a.transpose(t);
+	t.transpose(tt);
+	std::vector<size_t> in(n, 0);
+	for (size_t e = 0; e < a.edgeCount(); e++) in[a.target(e)]++;
+	for (int v = 0; v < n; v++)
+	{
+		assert(t.degree(v) == in[v] && tt.degree(v) == a.degree(v));
+		std::vector<std::pair<int, double> > x, y;
+		for (size_t e = a.begin(v); e < a.end(v); e++) x.push_back(std::make_pair(a.target(e), a.weight(e)));
+		for (size_t e = tt.begin(v); e < tt.end(v); e++) y.push_back(std::make_pair(tt.target(e), tt.weight(e)));
+		std::sort(x.begin(), x.end());
+		std::sort(y.begin(), y.end());
+		assert(x == y);
+		for (size_t e = tt.begin(v); e + 1 < tt.end(v); e++) assert(tt.target(e) <= tt.target(e + 1));
+	}
+
+	// the flow of the frozen graph is the one Graph reports
+	Graph flow(0);
+	std::vector<double> csrFlow;
+	double value = g.maxFlow(0, n - 1, flow);
+	assert(b.maxFlow(0, n - 1, csrFlow) == value);
+	assert(csrFlow.size() == b.edgeCount());
+	Graph frozen(n), frozenFlow(n);
+	for (int v = 0; v < n; v++)
+	{
+		for (size_t e = b.begin(v); e < b.end(v); e++)
+		{
+			frozen.add(v, b.target(e), b.weight(e));
+			frozenFlow.add(v, b.target(e), csrFlow[e]);
+		}
+	}
+	checkMaxFlow(frozen, frozenFlow, 0, n - 1, value);
+}
+
+void testShortestPaths()
+{
+	const double infinity = std::numeric_limits<double>::infinity();
+	for (int round = 0; round < 50; round++)
+	{
+		// random graphs with zero weights and unreachable parts, checked against Bellman-Ford
+		int n = 1 + std::rand() % 300;
+		std::vector<Graph::Edge> edges(std::rand() % (4 * n + 1));
+		for (size_t e = 0; e < edges.size(); e++)
+		{
+			Graph::Edge edge = { std::rand() % n, std::rand() % n, (double) (std::rand() % 20) * 0.5 };
+			edges[e] = edge;
+		}
+		CsrGraph g(n, edges.data(), edges.size());
+		int source = std::rand() % n;
+
+		std::vector<double> expected(n, infinity);
+		expected[source] = 0.0;
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+			for (size_t e = 0; e < edges.size(); e++)
+			{
+				if (expected[edges[e].from] + edges[e].cost < expected[edges[e].to])
+				{
+					expected[edges[e].to] = expected[edges[e].from] + edges[e].cost;
+					changed = true;
+				}
+			}
+		}
+
+		const shortestpath::Queue queues[] = { shortestpath::DaryHeap, shortestpath::RadixHeap };
+		for (size_t q = 0; q < 2; q++)
+		{
+			std::vector<double> distance;
+			std::vector<int> parent;
+			shortestpath::dijkstra(g, source, -1, distance, parent, queues[q]);
+			for (int v = 0; v < n; v++)
+			{
+				assert(distance[v] == expected[v]);
+				assert((parent[v] == -1) == (v == source || expected[v] == infinity));
+			}
+
+			// point to point, the path adds up to the distance
+			int target = std::rand() % n;
+			std::vector<int> path;
+			double length = shortestpath::path(g, source, target, path, queues[q]);
+			assert(length == expected[target]);
+			if (length == infinity)
+			{
+				assert(path.empty());
+				continue;
+			}
+			assert(path.front() == source && path.back() == target);
+			double sum = 0.0;
+			for (size_t i = 0; i + 1 < path.size(); i++)
+			{
+				double best = infinity;
+				for (size_t e = g.begin(path[i]); e < g.end(path[i]); e++)
+				{
+					if (g.target(e) == path[i + 1]) best = std::min(best, g.weight(e));
+				}
+				sum += best;
+			}
+			assert(sum == length);
+		}
+
+		for (size_t threads = 1; threads <= 4; threads += 3)
+		{
+			ThreadPool::setThreadCount(threads);
+			std::vector<double> distance;
+			shortestpath::deltaStepping(g, source, distance, (round % 3) * 2.0);
+			for (int v = 0; v < n; v++) assert(distance[v] == expected[v]);
+			// narrow buckets, the cyclic array wraps around many times
+			shortestpath::deltaStepping(g, source, distance, 0.1);
+			for (int v = 0; v < n; v++) assert(distance[v] == expected[v]);
+		}
+	}
+
+	// a grid big enough for the parallel relaxations
+	ThreadPool::setThreadCount(4);
+	CsrGraph road = roadGraph(200, 200);
+	std::vector<double> a, b;
+	std::vector<int> parent;
+	shortestpath::dijkstra(road, 0, -1, a, parent);
+	shortestpath::deltaStepping(road, 0, b);
+	assert(a == b);
+	// a delta far below the weights is raised to MaxBuckets buckets instead of one per delta of distance
+	shortestpath::deltaStepping(road, 0, b, 1e-9);
+	assert(a == b);
+	ThreadPool::setThreadCount(std::thread::hardware_concurrency());
+}
+
+// plain queue based BFS for reference
+void hopDistances(const CsrGraph& g, int source, std::vector<int>& outDistance)
+{
+	outDistance.assign(g.size(), -1);
+	std::vector<int> queue(1, source);
+	outDistance[source] = 0;
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		int v = queue[head];
+		for (size_t e = g.begin(v); e < g.end(v); e++)
+		{
+			int w = g.target(e);
+			if (outDistance[w] < 0)
+			{
+				outDistance[w] = outDistance[v] + 1;
+				queue.push_back(w);
+			}
+		}
+	}
+}
+
+void testBfs()
+{
+	const bfs::Direction directions[] = { bfs::DirectionOptimizing, bfs::TopDown, bfs::BottomUp };
+	for (size_t threads = 1; threads <= 4; threads += 3)
+	{
+		ThreadPool::setThreadCount(threads);
+		for (int round = 0; round < 30; round++)
+		{
+			// sizes around the word boundaries of the bitmaps, then graphs dense enough to switch direction
+			int n = (round < 10) ? 1 + round * 31 : 1000 + std::rand() % 20000;
+			std::vector<Graph::Edge> edges(round < 10 ? 2 * n : (size_t) n * (1 + round % 20));
+			for (size_t e = 0; e < edges.size(); e++)
+			{
+				Graph::Edge edge = { std::rand() % n, std::rand() % n, 1.0 };
+				edges[e] = edge;
+			}
+			CsrGraph g(n, edges.data(), edges.size()), transposed;
+			g.transpose(transposed);
+			int source = std::rand() % n;
+			std::vector<int> expected, distance;
+			hopDistances(g, source, expected);
+			for (size_t d = 0; d < 3; d++)
+			{
+				bfs::distances(g, transposed, source, distance, directions[d]);
+				assert(distance == expected);
+			}
+			bfs::distances(g, source, distance);
+			assert(distance == expected);
+		}
+	}
+
+	// a long path keeps the frontier at one node
+	CsrGraph road = roadGraph(300, 300);
+	std::vector<int> expected, distance;
+	hopDistances(road, 0, expected);
+	bfs::distances(road, road, 0, distance);
+	assert(distance == expected && distance[300 * 300 - 1] >= 598);
+	ThreadPool::setThreadCount(std::thread::hardware_concurrency());
+}
+
+void benchmarkMaxFlow()
+{
+	// a dense random graph and a long layered one, the shapes where each algorithm tends to lead
+	std::cout << "graph\tnodes\tedges\tdinic(s)\tpush-relabel(s)" << std::endl;
+	for (int shape = 0; shape < 2; shape++)
+	{
+		int n;
+		Graph g(0);
+		const char* name;
+		if (shape == 0)
+		{
+			name = "dense";
+			n = 2000;
+			g = Graph(n);
+			for (int v = 0; v < n; v++)
+			{
+				for (int j = 0; j < 200; j++) g.add(v, std::rand() % n, 1 + std::rand() % 1000);
+			}
+		}
+		else
+		{
+			// layers of 100 nodes with 5 edges from every node into the next layer
+			name = "layered";
+			const int width = 100, layers = 500;
+			n = width * layers + 2;
+			g = Graph(n);
+			for (int i = 0; i < width; i++)
+			{
+				g.add(0, 2 + i, 1000);
+				g.add(2 + (layers - 1) * width + i, 1, 1000);
+			}
+			for (int l = 0; l + 1 < layers; l++)
+			{
+				for (int i = 0; i < width; i++)
+				{
+					for (int j = 0; j < 5; j++) g.add(2 + l * width + i, 2 + (l + 1) * width + std::rand() % width, 1 + std::rand() % 100);
+				}
+			}
+		}
+		size_t edges = 0;
+		for (int v = 0; v < n; v++) edges += g.edges(v).size();
+
+		Graph flow(0);
+		int sink = (shape == 0) ? n - 1 : 1;
+		std::clock_t start = std::clock();
+		double a = g.maxFlow(0, sink, flow, Graph::Dinic);
+		double dinic = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+		start = std::clock();
+		double b = g.maxFlow(0, sink, flow, Graph::PushRelabel);
+		double pushRelabel = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+		assert(a == b);
+
+		std::cout << name << "\t" << n << "\t" << edges << "\t" << dinic << "\t" << pushRelabel << std::endl;
+	}
+}
+
+void benchmarkCsrGraph()
+{
+	// build and one pass over every edge, per node vectors against the frozen arrays
+	const int n = 1 << 20;
+	const size_t m = 16 * (size_t) n;
+	std::vector<Graph::Edge> edges(m);
+	for (size_t e = 0; e < m; e++)
+	{
+		Graph::Edge edge = { (int) (bigRand() % n), (int) (bigRand() % n), 1.0 };
+		edges[e] = edge;
+	}
+
+	std::cout << "edges\tgraph build(s)\tgraph scan(s)\tcsr build(s)\tcsr scan(s)" << std::endl;
+	std::clock_t start = std::clock();
+	Graph g(n);
+	for (size_t e = 0; e < m; e++) g.add(edges[e].from, edges[e].to, edges[e].cost);
+	double graphBuild = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+
+	start = std::clock();
+	double sum = 0.0;
+	for (int v = 0; v < n; v++)
+	{
+		const std::vector<Graph::Edge>& out = g.edges(v);
+		for (size_t j = 0; j < out.size(); j++) sum += out[j].to;
+	}
+	double graphScan = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+
+	start = std::clock();
+	CsrGraph csr(n, edges.data(), m);
+	double csrBuild = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+
+	start = std::clock();
+	double csrSum = 0.0;
+	for (size_t e = 0; e < csr.edgeCount(); e++) csrSum += csr.target(e);
+	double csrScan = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+	assert(sum == csrSum);
+
+	std::cout << m << "\t" << graphBuild << "\t" << graphScan << "\t" << csrBuild << "\t" << csrScan << std::endl;
+}
+
+void benchmarkShortestPaths()
+{
+	std::cout << "graph\tnodes\tedges\td-ary(s)\tradix(s)\tdelta-stepping(s)\tpoint to point(ms)" << std::endl;
+	for (int shape = 0; shape < 2; shape++)
+	{
+		CsrGraph g = (shape == 0) ? roadGraph(1000, 1000) : powerLawGraph(20, 16);
+		std::vector<double> distance, stepped;
+		std::vector<int> parent;
+
+		std::clock_t start = std::clock();
+		shortestpath::dijkstra(g, 0, -1, distance, parent, shortestpath::DaryHeap);
+		double dary = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+		start = std::clock();
+		shortestpath::dijkstra(g, 0, -1, distance, parent, shortestpath::RadixHeap);
+		double radix = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+		start = std::clock();
+		shortestpath::deltaStepping(g, 0, stepped);
+		double delta = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+		assert(stepped == distance);
+
+		// random pairs, the early exit settles only the nodes closer than the target
+		const int queries = 20;
+		std::vector<int> path;
+		start = std::clock();
+		for (int q = 0; q < queries; q++)
+		{
+			shortestpath::path(g, (int) (bigRand() % g.size()), (int) (bigRand() % g.size()), path);
+		}
+		double pointToPoint = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / queries;
+
+		std::cout << (shape == 0 ? "road" : "power-law") << "\t" << g.size() << "\t" << g.edgeCount() << "\t" << dary << "\t" << radix << "\t" << delta << "\t" << pointToPoint << std::endl;
+	}
+}
+
+void benchmarkBfs()
+{
+	std::cout << "graph\tnodes\tedges\tqueue(s)\ttop-down(s)\tbottom-up(s)\tdirection optimizing(s)" << std::endl;
+	for (int shape = 0; shape < 2; shape++)
+	{
+		CsrGraph g = (shape == 0) ? roadGraph(1000, 1000) : powerLawGraph(21, 16);
+		CsrGraph transposed;
+		g.transpose(transposed);
+		std::vector<int> expected, distance;
+
+		std::clock_t start = std::clock();
+		hopDistances(g, 0, expected);
+		std::cout << (shape == 0 ? "road" : "power-law") << "\t" << g.size() << "\t" << g.edgeCount() << "\t" << (double) (std::clock() - start) / CLOCKS_PER_SEC;
+
+		const bfs::Direction directions[] = { bfs::TopDown, bfs::BottomUp, bfs::DirectionOptimizing };
+		for (size_t d = 0; d < 3; d++)
+		{
+			start = std::clock();
+			bfs::distances(g, transposed, 0, distance, directions[d]);
+			std::cout << "\t" << (double) (std::clock() - start) / CLOCKS_PER_SEC;
+			assert(distance == expected);
+		}
+		std::cout << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	testMaxFlow();
+
+	testCsrGraph();
+
+	testShortestPaths();
+
+	testBfs();
+
+	benchmarkMaxFlow();
+
+	benchmarkCsrGraph();
+
+	benchmarkShortestPaths();
+
+	benchmarkBfs();
+
+	char _c;
+	std::cin >> _c;
+	return 0;
+}
@@ -0,0 +1,434 @@
+#pragma once
+
+#include "graph.h"
+#include <threadpool.h>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// Single source shortest paths on a CsrGraph with non-negative edge weights. Unreached nodes are at
+// infinity and have no parent (-1).
+namespace shortestpath
+{
+	enum Queue
+	{
+		// 4-ary heap with decrease-key: half the depth of a binary heap and the children of a node share a cache line
+		DaryHeap,
+		// Radix heap over the bit patterns of the distances, which order like the values for non-negative doubles.
+		// Dijkstra pops keys in increasing order, which is all a radix heap needs, and pushes cost O(1).
+		RadixHeap
+	};
+
+	// Dijkstra from source. With a target (not -1) the search stops once the target is settled, nodes settled
+	// by then have their exact distance and the others an upper bound.
+	void dijkstra(const CsrGraph& g, int source, int target, std::vector<double>& outDistance, std::vector<int>& outParent, Queue queue = DaryHeap);
+
+	// Point to point query: the distance from source to target, infinity when there is no path, and the nodes of
+	// a shortest path from source to target in outPath (empty when there is none).
+	double path(const CsrGraph& g, int source, int target, std::vector<int>& outPath, Queue queue = DaryHeap);
+
+	// Delta-stepping (Meyer and Sanders): nodes in buckets of width delta, every bucket emptied by rounds of
+	// relaxing the light edges (weight <= delta) of all its nodes in parallel on ThreadPool::shared(), the heavy
+	// edges once per bucket. delta 0 picks the largest weight over the average degree. The buckets are used
+	// cyclically, ceil(largest weight / delta) + 2 of them, and delta is raised so that there are at most
+	// MaxBuckets. Distances only.
+	const size_t MaxBuckets = 1 << 16;
+	void deltaStepping(const CsrGraph& g, int source, std::vector<double>& outDistance, double delta = 0.0);
+
+	// ---- Inline implementation ----
+
+	class DHeap
+	{
+	public:
+		DHeap(size_t nodeCount, const std::vector<double>& key) : position(nodeCount, -1), keys(key) {}
+
+		bool empty() const { return nodes.empty(); }
+
+		// adds v or moves it up after its key decreased
+		void update(int v)
+		{
+			if (position[v] < 0)
+			{
+				position[v] = (int) nodes.size();
+				nodes.push_back(v);
+			}
+			up(position[v]);
+		}
+
+		int pop()
+		{
+			int v = nodes[0];
+			position[v] = -1;
+			int last = nodes.back();
+			nodes.pop_back();
+			if (!nodes.empty())
+			{
+				nodes[0] = last;
+				position[last] = 0;
+				down(0);
+			}
+			return v;
+		}
+
+	private:
+		static const int D = 4;
+
+		void up(int i)
+		{
+			int v = nodes[i];
+			double k = keys[v];
+			while (i > 0)
+			{
+				int parent = (i - 1) / D;
+				if (keys[nodes[parent]] <= k)
+				{
+					break;
+				}
+				nodes[i] = nodes[parent];
+				position[nodes[i]] = i;
+				i = parent;
+			}
+			nodes[i] = v;
+			position[v] = i;
+		}
+
+		void down(int i)
+		{
+			int v = nodes[i];
+			double k = keys[v];
+			int size = (int) nodes.size();
+			while (true)
+			{
+				int first = D * i + 1;
+				if (first >= size)
+				{
+					break;
+				}
+				int best = first;
+				int last = std::min(first + D, size);
+				for (int c = first + 1; c < last; c++)
+				{
+					if (keys[nodes[c]] < keys[nodes[best]])
+					{
+						best = c;
+					}
+				}
+				if (keys[nodes[best]] >= k)
+				{
+					break;
+				}
+				nodes[i] = nodes[best];
+				position[nodes[i]] = i;
+				i = best;
+			}
+			nodes[i] = v;
+			position[v] = i;
+		}
+
+		std::vector<int> nodes;
+		std::vector<int> position;
+		const std::vector<double>& keys;
+	};
+
+	class RadixQueue
+	{
+	public:
+		RadixQueue() : last(0), count(0) {}
+
+		bool empty() const { return count == 0; }
+
+		static uint64_t bits(double key)
+		{
+			uint64_t b;
+			std::memcpy(&b, &key, sizeof(b));
+			return b;
+		}
+
+		// key is never below the last popped one
+		void push(double key, int v)
+		{
+			uint64_t b = bits(key);
+			buckets[bucketOf(b)].push_back(std::make_pair(b, v));
+			count++;
+		}
+
+		// some node with the smallest key, and that key in outKey
+		int pop(double& outKey)
+		{
+			if (buckets[0].empty())
+			{
+				// the smallest key of the first non empty bucket becomes the new base, which moves every key of
+				// that bucket to a lower one
+				size_t i = 1;
+				while (buckets[i].empty())
+				{
+					i++;
+				}
+				std::vector<std::pair<uint64_t, int> >& from = buckets[i];
+				last = from[0].first;
+				for (size_t j = 1; j < from.size(); j++)
+				{
+					last = std::min(last, from[j].first);
+				}
+				for (size_t j = 0; j < from.size(); j++)
+				{
+					buckets[bucketOf(from[j].first)].push_back(from[j]);
+				}
+				from.clear();
+			}
+			std::pair<uint64_t, int> top = buckets[0].back();
+			buckets[0].pop_back();
+			count--;
+			std::memcpy(&outKey, &top.first, sizeof(outKey));
+			return top.second;
+		}
+
+	private:
+		// 0 for the last popped key, otherwise one past the highest bit where the key differs from it
+		int bucketOf(uint64_t key) const
+		{
+			uint64_t x = key ^ last;
+			int bucket = 0;
+			for (int shift = 32; shift > 0; shift /= 2)
+			{
+				if (x >> shift)
+				{
+					x >>= shift;
+					bucket += shift;
+				}
+			}
+			return bucket + (int) x;
+		}
+
+		std::vector<std::pair<uint64_t, int> > buckets[65];
+		uint64_t last;
+		size_t count;
+	};
+
+	inline void dijkstra(const CsrGraph& g, int source, int target, std::vector<double>& outDistance, std::vector<int>& outParent, Queue queue)
+	{
+		size_t n = g.size();
+		const double infinity = std::numeric_limits<double>::infinity();
+		outDistance.assign(n, infinity);
+		outParent.assign(n, -1);
+		outDistance[source] = 0.0;
+		const size_t* offsets = g.edgeOffsets();
+		const int* targets = g.edgeTargets();
+		const double* weights = g.edgeWeights();
+
+		if (queue == DaryHeap)
+		{
+			DHeap heap(n, outDistance);
+			heap.update(source);
+			while (!heap.empty())
+			{
+				int v = heap.pop();
+				if (v == target)
+				{
+					return;
+				}
+				double dv = outDistance[v];
+				for (size_t e = offsets[v]; e < offsets[v + 1]; e++)
+				{
+					int w = targets[e];
+					double d = dv + weights[e];
+					if (d < outDistance[w])
+					{
+						outDistance[w] = d;
+						outParent[w] = v;
+						heap.update(w);
+					}
+				}
+			}
+			return;
+		}
+
+		// lazy deletion: a node is pushed again on every improvement and the outdated entries are skipped
+		RadixQueue radix;
+		std::vector<bool> settled(n, false);
+		radix.push(0.0, source);
+		while (!radix.empty())
+		{
+			double dv;
+			int v = radix.pop(dv);
+			if (settled[v] || dv > outDistance[v])
+			{
+				continue;
+			}
+			settled[v] = true;
+			if (v == target)
+			{
+				return;
+			}
+			for (size_t e = offsets[v]; e < offsets[v + 1]; e++)
+			{
+				int w = targets[e];
+				double d = dv + weights[e];
+				if (d < outDistance[w])
+				{
+					outDistance[w] = d;
+					outParent[w] = v;
+					radix.push(d, w);
+				}
+			}
+		}
+	}
+
+	inline double path(const CsrGraph& g, int source, int target, std::vector<int>& outPath, Queue queue)
+	{
+		std::vector<double> distance;
+		std::vector<int> parent;
+		dijkstra(g, source, target, distance, parent, queue);
+
+		outPath.clear();
+		if (distance[target] == std::numeric_limits<double>::infinity())
+		{
+			return distance[target];
+		}
+		for (int v = target; v != -1; v = parent[v])
+		{
+			outPath.push_back(v);
+		}
+		std::reverse(outPath.begin(), outPath.end());
+		return distance[target];
+	}
+
+	inline void deltaStepping(const CsrGraph& g, int source, std::vector<double>& outDistance, double delta)
+	{
+		size_t n = g.size();
+		const double infinity = std::numeric_limits<double>::infinity();
+		const size_t* offsets = g.edgeOffsets();
+		const int* targets = g.edgeTargets();
+		const double* weights = g.edgeWeights();
+
+		double heaviest = 0.0;
+		for (size_t e = 0; e < g.edgeCount(); e++)
+		{
+			heaviest = std::max(heaviest, weights[e]);
+		}
+		if (delta <= 0.0)
+		{
+			double averageDegree = n ? (double) g.edgeCount() / n : 1.0;
+			delta = (heaviest > 0.0) ? heaviest / std::max(averageDegree, 1.0) : 1.0;
+		}
+		delta = std::max(delta, heaviest / (MaxBuckets - 2));
+
+		std::vector<std::atomic<double> > distance(n);
+		for (size_t v = 0; v < n; v++)
+		{
+			distance[v].store(infinity, std::memory_order_relaxed);
+		}
+		distance[source].store(0.0, std::memory_order_relaxed);
+
+		// Relaxing a node of bucket i gives distances below (i + 1) delta + heaviest, so the pending nodes are
+		// in buckets i to i + ceil(heaviest / delta), one more absorbs rounding. Bucket b lives at b % count.
+		size_t count = (size_t) std::ceil(heaviest / delta) + 2;
+		std::vector<std::vector<int> > buckets(count);
+		buckets[0].push_back(source);
+		// entries in the buckets, stale ones included
+		size_t pending = 1;
+		std::vector<size_t> stamp(n, (size_t) -1);
+		std::vector<size_t> settledStamp(n, (size_t) -1);
+		std::vector<int> frontier, settled;
+		ThreadPool& pool = ThreadPool::shared();
+		const size_t grain = 256;
+		std::vector<std::vector<int> > improved(pool.size() * 4);
+		size_t round = 0;
+
+		// relaxes the light or the heavy edges of nodes, every chunk lists the targets it improved
+		auto relax = [&](const std::vector<int>& nodes, bool light)
+		{
+			size_t chunks = std::min(improved.size(), (nodes.size() + grain - 1) / grain);
+			auto work = [&](size_t first, size_t last)
+			{
+				for (size_t c = first; c < last; c++)
+				{
+					std::vector<int>& out = improved[c];
+					for (size_t i = nodes.size() * c / chunks; i < nodes.size() * (c + 1) / chunks; i++)
+					{
+						int v = nodes[i];
+						double dv = distance[v].load(std::memory_order_relaxed);
+						for (size_t e = offsets[v]; e < offsets[v + 1]; e++)
+						{
+							if ((weights[e] <= delta) != light)
+							{
+								continue;
+							}
+							int w = targets[e];
+							double d = dv + weights[e];
+							double current = distance[w].load(std::memory_order_relaxed);
+							while (d < current)
+							{
+								if (distance[w].compare_exchange_weak(current, d, std::memory_order_relaxed))
+								{
+									out.push_back(w);
+									break;
+								}
+							}
+						}
+					}
+				}
+			};
+			if (chunks > 1)
+			{
+				pool.parallelFor(0, chunks, 1, work);
+			}
+			else if (chunks == 1)
+			{
+				work(0, 1);
+			}
+
+			// improved nodes into the buckets of their new distances, duplicates are weeded out when a bucket is taken
+			for (size_t c = 0; c < chunks; c++)
+			{
+				for (size_t i = 0; i < improved[c].size(); i++)
+				{
+					int w = improved[c][i];
+					size_t b = (size_t) (distance[w].load(std::memory_order_relaxed) / delta);
+					buckets[b % count].push_back(w);
+				}
+				pending += improved[c].size();
+				improved[c].clear();
+			}
+		};
+
+		for (size_t i = 0; pending > 0; i++)
+		{
+			std::vector<int>& bucket = buckets[i % count];
+			settled.clear();
+			while (!bucket.empty())
+			{
+				// nodes still in bucket i, each once per round
+				frontier.clear();
+				round++;
+				pending -= bucket.size();
+				for (size_t j = 0; j < bucket.size(); j++)
+				{
+					int v = bucket[j];
+					if (stamp[v] != round && (size_t) (distance[v].load(std::memory_order_relaxed) / delta) == i)
+					{
+						stamp[v] = round;
+						frontier.push_back(v);
+						if (settledStamp[v] != i)
+						{
+							settledStamp[v] = i;
+							settled.push_back(v);
+						}
+					}
+				}
+				bucket.clear();
+				relax(frontier, true);
+			}
+			relax(settled, false);
+		}
+
+		outDistance.resize(n);
+		for (size_t v = 0; v < n; v++)
+		{
+			outDistance[v] = distance[v].load(std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,107 @@
+#include "convolver.h"
+#include <cassert>
+#include <cstring>
+
+namespace fft
+{
+	namespace
+	{
+		size_t defaultBlock(size_t kernelSize, size_t blockSize)
+		{
+			if (blockSize == 0)
+			{
+				// long enough that the kernel overlap is a small part of every transform
+				blockSize = std::max<size_t>(4 * kernelSize, 1 << 14);
+			}
+			return blockSize;
+		}
+	}
+
+	StreamConvolver::StreamConvolver(const Polynomial& kernel, size_t blockSize)
+		: kernelSize(kernel.size()),
+		  block(defaultBlock(kernel.size(), blockSize)),
+		  spectrum(kernel, block + kernel.size() - 1),
+		  written(0)
+	{
+		assert(kernelSize > 0);
+
+		// the transform size is rounded up, the blocks take the extra room
+		block = spectrum.capacity() - (kernelSize - 1);
+		pending.reserve(block);
+		tail.resize(kernelSize - 1);
+	}
+
+	size_t StreamConvolver::run(galib::io::IReader& in, galib::io::IWriter& out)
+	{
+		// reads can end in the middle of a sample, the partial bytes wait for the next read
+		std::vector<char> bytes(block * sizeof(double));
+		std::vector<double> samples(block);
+		size_t filled = 0;
+		size_t start = written;
+		for (;;)
+		{
+			size_t n = in.read(bytes.data() + filled, bytes.size() - filled);
+			if (n == 0)
+			{
+				break;
+			}
+			filled += n;
+
+			size_t count = filled / sizeof(double);
+			std::memcpy(samples.data(), bytes.data(), count * sizeof(double));
+			process(samples.data(), count, out);
+
+			size_t rest = filled - count * sizeof(double);
+			std::memmove(bytes.data(), bytes.data() + count * sizeof(double), rest);
+			filled = rest;
+		}
+		finish(out);
+		return written - start;
+	}
+
+	void StreamConvolver::process(const double* samples, size_t count, galib::io::IWriter& out)
+	{
+		while (count > 0)
+		{
+			size_t take = std::min(count, block - pending.size());
+			size_t size = pending.size();
+			pending.resize(size + take);
+			std::copy(samples, samples + take, pending.data() + size);
+			samples += take;
+			count -= take;
+
+			if (pending.size() == block)
+			{
+				convolveBlock(out);
+			}
+		}
+	}
+
+	void StreamConvolver::finish(galib::io::IWriter& out)
+	{
+		if (pending.size() > 0)
+		{
+			convolveBlock(out);
+		}
+		// what is left spills past the end of the input
+		out.write(reinterpret_cast<const char*>(tail.data()), tail.size() * sizeof(double));
+		written += tail.size();
+		std::fill(tail.data(), tail.data() + tail.size(), 0.0);
+	}
+
+	void StreamConvolver::convolveBlock(galib::io::IWriter& out)
+	{
+		size_t count = pending.size();
+		spectrum.multiply(pending, result);
+		result.resize(count + kernelSize - 1);
+		for (size_t i = 0; i < tail.size(); i++)
+		{
+			result[i] += tail[i];
+		}
+
+		out.write(reinterpret_cast<const char*>(result.data()), count * sizeof(double));
+		written += count;
+		std::copy(result.data() + count, result.data() + count + tail.size(), tail.data());
+		pending.resize(0);
+	}
+}
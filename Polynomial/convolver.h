@@ -0,0 +1,43 @@
+#pragma once
+
+#include "spectral.h"
+#include <cstring> // galib/io/reader.h uses strncpy without including it
+#include <galib/io/reader.h>
+#include <galib/io/writer.h>
+
+namespace fft
+{
+	// Convolution of an unbounded stream of samples with a fixed kernel by overlap-add.
+	// The input is cut into blocks, each block is multiplied with the kernel spectrum (transformed once)
+	// and the kernel.size() - 1 samples that spill past the block are added to the next one.
+	// Memory is bounded by the block and kernel sizes, independent of the stream length.
+	// Samples are raw doubles in native byte order on both ends.
+	class StreamConvolver
+	{
+	public:
+		// blockSize 0 picks a few times the kernel size. The block is grown to fill the transform.
+		StreamConvolver(const Polynomial& kernel, size_t blockSize = 0);
+
+		size_t blockSize() const { return block; }
+
+		// Reads samples until the reader is exhausted and writes the whole convolution,
+		// input length + kernel.size() - 1 samples. Trailing bytes short of a sample are dropped.
+		// Returns the number of samples written.
+		size_t run(galib::io::IReader& in, galib::io::IWriter& out);
+
+		// The same, driven by the caller: any number of process calls followed by finish.
+		void process(const double* samples, size_t count, galib::io::IWriter& out);
+		void finish(galib::io::IWriter& out);
+
+	private:
+		void convolveBlock(galib::io::IWriter& out);
+
+		size_t kernelSize;
+		size_t block;
+		SpectralPolynomial spectrum;
+		Polynomial pending;   // input of the current block
+		Polynomial tail;      // overlap from the previous block, kernelSize - 1 samples
+		Polynomial result;
+		size_t written;
+	};
+}
@@ -0,0 +1,97 @@
+#include "cpu.h"
+
+#ifdef CPU_X86
+# if defined(_MSC_VER)
+#  include <intrin.h>
+# else
+#  include <cpuid.h>
+# endif
+#endif
+
+namespace cpu
+{
+	namespace
+	{
+#ifdef CPU_X86
+		void cpuid(int leaf, int subleaf, unsigned int regs[4])
+		{
+#if defined(_MSC_VER)
+			int r[4];
+			__cpuidex(r, leaf, subleaf);
+			for (int i = 0; i < 4; i++) regs[i] = (unsigned int) r[i];
+#else
+			__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		}
+
+		unsigned long long xgetbv0()
+		{
+#if defined(_MSC_VER)
+			return _xgetbv(0);
+#else
+			unsigned int eax, edx;
+			__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return ((unsigned long long) edx << 32) | eax;
+#endif
+		}
+#endif
+
+		Level detect()
+		{
+			Level level = Scalar;
+#ifdef CPU_X86
+			unsigned int regs[4];
+			cpuid(0, 0, regs);
+			if (regs[0] < 7)
+			{
+				return level;
+			}
+
+			cpuid(1, 0, regs);
+			bool osxsave = (regs[2] & (1u << 27)) != 0;
+			bool fma = (regs[2] & (1u << 12)) != 0;
+			if (!osxsave)
+			{
+				return level;
+			}
+
+			// the OS must save the YMM (and for AVX-512 the ZMM and mask) registers on context switches
+			unsigned long long xcr0 = xgetbv0();
+			cpuid(7, 0, regs);
+			if ((xcr0 & 0x6) == 0x6 && fma && (regs[1] & (1u << 5)))
+			{
+				level = Avx2;
+			}
+#ifdef CPU_AVX512
+			if (level == Avx2 && (xcr0 & 0xe6) == 0xe6 && (regs[1] & (1u << 16)))
+			{
+				level = Avx512;
+			}
+#endif
+#endif
+			return level;
+		}
+
+		Level& overridden()
+		{
+			static Level level = detected();
+			return level;
+		}
+	}
+
+	Level detected()
+	{
+		static Level level = detect();
+		return level;
+	}
+
+	Level current()
+	{
+		return overridden();
+	}
+
+	void setLevel(Level level)
+	{
+		overridden() = (level > detected()) ? detected() : level;
+	}
+}
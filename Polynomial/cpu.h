@@ -0,0 +1,40 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+# define CPU_X86
+# include <immintrin.h>
+#endif
+
+// GCC and clang only emit AVX instructions in functions that ask for them, MSVC always can.
+// Vector kernels are marked with these and only called when current() allows it.
+#if defined(CPU_X86) && defined(__GNUC__)
+# define CPU_TARGET_AVX2   __attribute__((target("avx2,fma")))
+# define CPU_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+# define CPU_TARGET_AVX2
+# define CPU_TARGET_AVX512
+#endif
+
+// AVX-512 intrinsics arrived with Visual Studio 2017.
+#if defined(CPU_X86) && (!defined(_MSC_VER) || _MSC_VER >= 1910)
+# define CPU_AVX512
+#endif
+
+// Instruction set extensions of the running CPU, for the modules that pick a vector kernel at run time.
+namespace cpu
+{
+	enum Level
+	{
+		Scalar,
+		Avx2,
+		Avx512
+	};
+
+	// Best level supported by the build and the running CPU, detected once through CPUID.
+	// Avx2 includes FMA.
+	Level detected();
+
+	// Level the kernels should use, detected() unless overridden. Overriding is meant for tests and benchmarks.
+	Level current();
+	void setLevel(Level level);
+}
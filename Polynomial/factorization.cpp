@@ -0,0 +1,551 @@
+#include "factorization.h"
+#include <threadpool.h>
+#include <cassert>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+	// Panel width: wide enough that the trailing gemm runs near its peak, narrow enough that the
+	// unblocked panel work stays a small share of the total.
+	const size_t Block = 128;
+	const size_t QRBlock = 64;
+
+	// f over [begin, end), on the shared pool when there are enough flops to share
+	void forRange(size_t begin, size_t end, size_t grain, double flops, const std::function<void(size_t, size_t)>& f)
+	{
+		ThreadPool& pool = ThreadPool::shared();
+		if (pool.size() > 1 && flops >= 1e5 && end - begin > grain)
+		{
+			pool.parallelFor(begin, end, grain, f);
+		}
+		else
+		{
+			f(begin, end);
+		}
+	}
+}
+
+LU::LU(const Matrix& a)
+	: lu(a), pivot(a.rows()), isSingular(false), swaps(0)
+{
+	assert(a.rows() == a.columns());
+	size_t n = lu.rows();
+	size_t ld = lu.stride();
+
+	for (size_t k0 = 0; k0 < n; k0 += Block)
+	{
+		size_t k1 = std::min(n, k0 + Block);
+
+		// panel: columns k0..k1 eliminated below the diagonal, the swaps are applied to whole rows
+		for (size_t k = k0; k < k1; k++)
+		{
+			size_t p = k;
+			double best = std::fabs(lu(k, k));
+			for (size_t i = k + 1; i < n; i++)
+			{
+				double v = std::fabs(lu(i, k));
+				if (v > best)
+				{
+					best = v;
+					p = i;
+				}
+			}
+			pivot[k] = p;
+			if (p != k)
+			{
+				std::swap_ranges(lu.row(k), lu.row(k) + n, lu.row(p));
+				swaps++;
+			}
+			if (best == 0.0)
+			{
+				isSingular = true;
+				continue;
+			}
+
+			double inverse = 1.0 / lu(k, k);
+			const double* rk = lu.row(k);
+			auto eliminate = [&](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+				{
+					double* ri = lu.row(i);
+					double l = ri[k] *= inverse;
+					for (size_t j = k + 1; j < k1; j++)
+					{
+						ri[j] -= l * rk[j];
+					}
+				}
+			};
+			forRange(k + 1, n, 256, 2.0 * (n - k) * (k1 - k), eliminate);
+		}
+		if (k1 == n)
+		{
+			break;
+		}
+
+		// U12 = L11^-1 A12, every column on its own
+		auto solveColumns = [&](size_t first, size_t last)
+		{
+			for (size_t k = k0; k < k1; k++)
+			{
+				const double* rk = lu.row(k);
+				for (size_t i = k + 1; i < k1; i++)
+				{
+					double* ri = lu.row(i);
+					double l = ri[k];
+					for (size_t j = first; j < last; j++)
+					{
+						ri[j] -= l * rk[j];
+					}
+				}
+			}
+		};
+		forRange(k1, n, 64, (double) (k1 - k0) * (k1 - k0) * (n - k1), solveColumns);
+
+		// A22 -= L21 U12
+		gemm(n - k1, n - k1, k1 - k0, -1.0, lu.row(k1) + k0, ld, lu.row(k0) + k1, ld, 1.0, lu.row(k1) + k1, ld);
+	}
+}
+
+double LU::determinant() const
+{
+	if (isSingular)
+	{
+		return 0.0;
+	}
+	double d = (swaps % 2) ? -1.0 : 1.0;
+	for (size_t i = 0; i < lu.rows(); i++)
+	{
+		d *= lu(i, i);
+	}
+	return d;
+}
+
+bool LU::solve(const double* b, double* outX) const
+{
+	if (isSingular)
+	{
+		return false;
+	}
+
+	size_t n = lu.rows();
+	if (outX != b)
+	{
+		std::copy(b, b + n, outX);
+	}
+	for (size_t k = 0; k < n; k++)
+	{
+		std::swap(outX[k], outX[pivot[k]]);
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		const double* ri = lu.row(i);
+		double s = outX[i];
+		for (size_t j = 0; j < i; j++)
+		{
+			s -= ri[j] * outX[j];
+		}
+		outX[i] = s;
+	}
+	for (size_t i = n; i-- > 0;)
+	{
+		const double* ri = lu.row(i);
+		double s = outX[i];
+		for (size_t j = i + 1; j < n; j++)
+		{
+			s -= ri[j] * outX[j];
+		}
+		outX[i] = s / ri[i];
+	}
+	return true;
+}
+
+Cholesky::Cholesky(const Matrix& a)
+	: l(a), isPositiveDefinite(true)
+{
+	assert(a.rows() == a.columns());
+	size_t n = l.rows();
+	size_t ld = l.stride();
+
+	for (size_t k0 = 0; k0 < n; k0 += Block)
+	{
+		size_t k1 = std::min(n, k0 + Block);
+		size_t kb = k1 - k0;
+
+		// diagonal block, the earlier panels are already subtracted from it
+		for (size_t j = k0; j < k1; j++)
+		{
+			double* rj = l.row(j);
+			double s = rj[j];
+			for (size_t p = k0; p < j; p++)
+			{
+				s -= rj[p] * rj[p];
+			}
+			if (!(s > 0.0))
+			{
+				isPositiveDefinite = false;
+				return;
+			}
+			rj[j] = std::sqrt(s);
+			for (size_t i = j + 1; i < k1; i++)
+			{
+				double* ri = l.row(i);
+				double t = ri[j];
+				for (size_t p = k0; p < j; p++)
+				{
+					t -= ri[p] * rj[p];
+				}
+				ri[j] = t / rj[j];
+			}
+		}
+		if (k1 == n)
+		{
+			break;
+		}
+
+		// L21 = A21 L11^-T, every row on its own
+		auto solveRows = [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				double* ri = l.row(i);
+				for (size_t j = k0; j < k1; j++)
+				{
+					const double* rj = l.row(j);
+					double t = ri[j];
+					for (size_t p = k0; p < j; p++)
+					{
+						t -= ri[p] * rj[p];
+					}
+					ri[j] = t / rj[j];
+				}
+			}
+		};
+		forRange(k1, n, 64, (double) kb * kb * (n - k1), solveRows);
+
+		// A22 -= L21 L21^T on and below the diagonal, a row of tiles per task
+		Matrix t(kb, n - k1);
+		for (size_t i = k1; i < n; i++)
+		{
+			const double* ri = l.row(i) + k0;
+			for (size_t p = 0; p < kb; p++)
+			{
+				t(p, i - k1) = ri[p];
+			}
+		}
+		auto update = [&](size_t first, size_t last)
+		{
+			for (size_t tile = first; tile < last; tile++)
+			{
+				size_t i0 = k1 + tile * Block;
+				size_t i1 = std::min(n, i0 + Block);
+				gemm(i1 - i0, i1 - k1, kb, -1.0, l.row(i0) + k0, ld, t.data(), t.stride(), 1.0, l.row(i0) + k1, ld);
+			}
+		};
+		size_t tiles = (n - k1 + Block - 1) / Block;
+		forRange(0, tiles, 1, (double) kb * (n - k1) * (n - k1), update);
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		std::fill(l.row(i) + i + 1, l.row(i) + n, 0.0);
+	}
+}
+
+double Cholesky::determinant() const
+{
+	if (!isPositiveDefinite)
+	{
+		return 0.0;
+	}
+	double d = 1.0;
+	for (size_t i = 0; i < l.rows(); i++)
+	{
+		d *= l(i, i) * l(i, i);
+	}
+	return d;
+}
+
+bool Cholesky::solve(const double* b, double* outX) const
+{
+	if (!isPositiveDefinite)
+	{
+		return false;
+	}
+
+	// L y = b, then L^T x = y by subtracting whole rows of L so that the access stays row-major
+	size_t n = l.rows();
+	std::vector<double> y(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		const double* ri = l.row(i);
+		double s = b[i];
+		for (size_t j = 0; j < i; j++)
+		{
+			s -= ri[j] * y[j];
+		}
+		y[i] = s / ri[i];
+	}
+	for (size_t i = n; i-- > 0;)
+	{
+		const double* ri = l.row(i);
+		double xi = y[i] / ri[i];
+		outX[i] = xi;
+		for (size_t j = 0; j < i; j++)
+		{
+			y[j] -= ri[j] * xi;
+		}
+	}
+	return true;
+}
+
+QR::QR(const Matrix& a)
+	: qr(a), tau(a.columns())
+{
+	assert(a.rows() >= a.columns());
+	size_t m = qr.rows();
+	size_t n = qr.columns();
+	size_t ld = qr.stride();
+	std::vector<double> w(QRBlock);
+
+	for (size_t k0 = 0; k0 < n; k0 += QRBlock)
+	{
+		size_t k1 = std::min(n, k0 + QRBlock);
+		size_t kb = k1 - k0;
+
+		// panel: H_j = I - tau_j v_j v_j^T maps column j onto beta e_j, v_j is 1 at row j and stored below it
+		for (size_t j = k0; j < k1; j++)
+		{
+			double norm2 = 0.0;
+			for (size_t i = j + 1; i < m; i++)
+			{
+				norm2 += qr(i, j) * qr(i, j);
+			}
+			if (norm2 == 0.0)
+			{
+				tau[j] = 0.0;
+				continue;
+			}
+			double x0 = qr(j, j);
+			double beta = -std::copysign(std::sqrt(x0 * x0 + norm2), x0);
+			tau[j] = (beta - x0) / beta;
+			double scale = 1.0 / (x0 - beta);
+			for (size_t i = j + 1; i < m; i++)
+			{
+				qr(i, j) *= scale;
+			}
+			qr(j, j) = beta;
+
+			// the rest of the panel, w = v^T A summed a row at a time
+			size_t c0 = j + 1;
+			std::copy(qr.row(j) + c0, qr.row(j) + k1, w.begin());
+			for (size_t i = j + 1; i < m; i++)
+			{
+				const double* ri = qr.row(i);
+				for (size_t c = c0; c < k1; c++)
+				{
+					w[c - c0] += ri[j] * ri[c];
+				}
+			}
+			for (size_t c = c0; c < k1; c++)
+			{
+				w[c - c0] *= tau[j];
+				qr(j, c) -= w[c - c0];
+			}
+			for (size_t i = j + 1; i < m; i++)
+			{
+				double* ri = qr.row(i);
+				for (size_t c = c0; c < k1; c++)
+				{
+					ri[c] -= ri[j] * w[c - c0];
+				}
+			}
+		}
+		if (k1 == n)
+		{
+			break;
+		}
+
+		// H_k0 ... H_k1-1 = I - V T V^T with T upper triangular, built a column at a time
+		size_t h = m - k0;
+		Matrix vt(kb, h);
+		for (size_t p = 0; p < kb; p++)
+		{
+			double* vp = vt.row(p);
+			vp[p] = 1.0;
+			for (size_t i = k0 + p + 1; i < m; i++)
+			{
+				vp[i - k0] = qr(i, k0 + p);
+			}
+		}
+		Matrix t(kb, kb);
+		std::vector<double> z(kb);
+		for (size_t j = 0; j < kb; j++)
+		{
+			// T(0:j, j) = -tau_j T(0:j, 0:j) V(:, 0:j)^T v_j
+			const double* vj = vt.row(j);
+			for (size_t p = 0; p < j; p++)
+			{
+				const double* vp = vt.row(p);
+				double s = 0.0;
+				for (size_t i = j; i < h; i++)
+				{
+					s += vp[i] * vj[i];
+				}
+				z[p] = s;
+			}
+			for (size_t p = 0; p < j; p++)
+			{
+				double s = 0.0;
+				for (size_t q = p; q < j; q++)
+				{
+					s += t(p, q) * z[q];
+				}
+				t(p, j) = -tau[k0 + j] * s;
+			}
+			t(j, j) = tau[k0 + j];
+		}
+
+		// trailing columns C = Q^T C = C - V T^T V^T C, both products through gemm
+		size_t nt = n - k1;
+		Matrix wt(kb, nt);
+		gemm(kb, nt, h, 1.0, vt.data(), vt.stride(), qr.row(k0) + k1, ld, 0.0, wt.data(), wt.stride());
+		for (size_t p = kb; p-- > 0;)
+		{
+			// row p of T^T W only needs rows up to p, so going down keeps the inputs intact
+			double* wp = wt.row(p);
+			double tpp = t(p, p);
+			for (size_t c = 0; c < nt; c++)
+			{
+				wp[c] *= tpp;
+			}
+			for (size_t q = 0; q < p; q++)
+			{
+				const double* wq = wt.row(q);
+				double tqp = t(q, p);
+				for (size_t c = 0; c < nt; c++)
+				{
+					wp[c] += tqp * wq[c];
+				}
+			}
+		}
+		Matrix v;
+		vt.transpose(v);
+		gemm(h, nt, kb, -1.0, v.data(), v.stride(), wt.data(), wt.stride(), 1.0, qr.row(k0) + k1, ld);
+	}
+}
+
+void QR::applyTransposed(double* x) const
+{
+	// Q^T x = H_n-1 ... H_0 x
+	size_t m = qr.rows();
+	for (size_t j = 0; j < qr.columns(); j++)
+	{
+		if (tau[j] == 0.0)
+		{
+			continue;
+		}
+		double w = x[j];
+		for (size_t i = j + 1; i < m; i++)
+		{
+			w += qr(i, j) * x[i];
+		}
+		w *= tau[j];
+		x[j] -= w;
+		for (size_t i = j + 1; i < m; i++)
+		{
+			x[i] -= qr(i, j) * w;
+		}
+	}
+}
+
+bool QR::solve(const double* b, double* outX) const
+{
+	size_t m = qr.rows();
+	size_t n = qr.columns();
+	std::vector<double> y(b, b + m);
+	applyTransposed(y.data());
+
+	// R x = the first n values of Q^T b
+	for (size_t i = n; i-- > 0;)
+	{
+		const double* ri = qr.row(i);
+		if (ri[i] == 0.0)
+		{
+			return false;
+		}
+		double s = y[i];
+		for (size_t j = i + 1; j < n; j++)
+		{
+			s -= ri[j] * outX[j];
+		}
+		outX[i] = s / ri[i];
+	}
+	return true;
+}
+
+void QR::q(Matrix& outQ) const
+{
+	// H_0 ... H_n-1 applied to the first n columns of the identity, last reflector first. H_j leaves
+	// columns below j alone since they are still unit vectors above row j.
+	size_t m = qr.rows();
+	size_t n = qr.columns();
+	outQ.resize(m, n);
+	for (size_t i = 0; i < n; i++)
+	{
+		outQ(i, i) = 1.0;
+	}
+	std::vector<double> w(n);
+	for (size_t j = n; j-- > 0;)
+	{
+		if (tau[j] == 0.0)
+		{
+			continue;
+		}
+		std::copy(outQ.row(j) + j, outQ.row(j) + n, w.begin() + j);
+		for (size_t i = j + 1; i < m; i++)
+		{
+			const double* qi = outQ.row(i);
+			double vi = qr(i, j);
+			for (size_t c = j; c < n; c++)
+			{
+				w[c] += vi * qi[c];
+			}
+		}
+		for (size_t c = j; c < n; c++)
+		{
+			w[c] *= tau[j];
+			outQ(j, c) -= w[c];
+		}
+		for (size_t i = j + 1; i < m; i++)
+		{
+			double* qi = outQ.row(i);
+			double vi = qr(i, j);
+			for (size_t c = j; c < n; c++)
+			{
+				qi[c] -= vi * w[c];
+			}
+		}
+	}
+}
+
+void QR::r(Matrix& outR) const
+{
+	size_t n = qr.columns();
+	outR.resize(n, n);
+	for (size_t i = 0; i < n; i++)
+	{
+		std::copy(qr.row(i) + i, qr.row(i) + n, outR.row(i) + i);
+	}
+}
+
+bool Matrix::solve(const double* b, double* outX) const
+{
+	return LU(*this).solve(b, outX);
+}
+
+double Matrix::determinant() const
+{
+	return LU(*this).determinant();
+}
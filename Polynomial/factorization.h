@@ -0,0 +1,68 @@
+#pragma once
+
+#include "matrix.h"
+#include <vector>
+
+// Blocked right-looking factorizations: a narrow panel is factored directly, the rest of the matrix is
+// updated with gemm, which carries most of the work and spreads it over ThreadPool::shared().
+// The triangular solves against a panel run in parallel over independent columns or rows.
+
+// P A = L U with partial pivoting, A square. L (unit diagonal, not stored) and U share one matrix.
+class LU
+{
+public:
+	LU(const Matrix& a);
+
+	bool singular() const                       { return isSingular; }
+	const Matrix& factors() const               { return lu; }
+	// Row i was swapped with row pivots()[i] at step i.
+	const std::vector<size_t>& pivots() const   { return pivot; }
+
+	double determinant() const;
+	// Solves A x = b, false if A is singular.
+	bool solve(const double* b, double* outX) const;
+
+private:
+	Matrix lu;
+	std::vector<size_t> pivot;
+	bool isSingular;
+	int swaps;
+};
+
+// A = L L^T for a symmetric positive definite A, only the lower triangle of A is read.
+class Cholesky
+{
+public:
+	Cholesky(const Matrix& a);
+
+	bool positiveDefinite() const   { return isPositiveDefinite; }
+	// L, zero above the diagonal.
+	const Matrix& factor() const    { return l; }
+
+	double determinant() const;
+	bool solve(const double* b, double* outX) const;
+
+private:
+	Matrix l;
+	bool isPositiveDefinite;
+};
+
+// A = Q R by Householder reflections for rows() >= columns(), applied to the trailing columns in
+// blocks through the compact WY form I - V T V^T.
+class QR
+{
+public:
+	QR(const Matrix& a);
+
+	// Least squares solution of A x = b: b has rows() values, x columns() values. False if R is singular.
+	bool solve(const double* b, double* outX) const;
+	// Thin factors, Q is rows() x columns() with orthonormal columns and R is columns() x columns().
+	void q(Matrix& outQ) const;
+	void r(Matrix& outR) const;
+
+private:
+	void applyTransposed(double* x) const;
+
+	Matrix qr;                  // R on and above the diagonal, the reflectors below it (with implicit 1s)
+	std::vector<double> tau;
+};
@@ -1,5 +1,10 @@
 #include "fft.h"
+#include "fft_simd.h"
+#include <threadpool.h>
 #include <cassert>
+#include <map>
+#include <memory>
+#include <mutex>
 
 namespace fft
 {
@@ -14,70 +19,674 @@ namespace fft
 		}
 	}
 
-	void transformInplace(PolynomialComplex& polynomial, bool inverse)
+	size_t fastSize(size_t minimum)
 	{
-		double angle, wtmp, wpr, wpi, wr, wi;
-		int n = 1, n2;
-		double pi = 3.14159265358979323846;
-		double pi2 = 3.14159265358979323846 * 2.0;
+		for (size_t n = std::max<size_t>(minimum, 1); ; n++)
+		{
+			size_t r = n;
+			while (r % 2 == 0) r /= 2;
+			while (r % 3 == 0) r /= 3;
+			while (r % 5 == 0) r /= 5;
+			if (r == 1)
+			{
+				return n;
+			}
+		}
+	}
 
-		int size = (int) polynomial.size();
-		double scale = 1.0/size;
-		std::complex<double> tc;
+	namespace
+	{
+		const double pi2 = 3.14159265358979323846 * 2.0;
 
-		int log2n = 0, size2 = 1;
-		findPowOfToAndLog(size, size2, log2n);
+		size_t& sixStepMinSizeSetting()
+		{
+			// 2^22 points are 64MB, past the last level cache of most machines we run on.
+			// Below that the direct radix-4 passes were faster in our measurements.
+			static size_t size = 1 << 22;
+			return size;
+		}
 
-		if(size != size2)
+		size_t& parallelMinSizeSetting()
 		{
-			polynomial.resize(size2);
+			static size_t size = 1 << 16;
+			return size;
+		}
+
+		const size_t Tile = 16;
+
+		// dst[c * rows + r] = src[r * cols + c] for the rows in [rowBegin, rowEnd), in tiles small
+		// enough for both sides to stay in L1
+		void transposeBlocked(const std::complex<double>* src, std::complex<double>* dst, size_t rows, size_t cols, size_t rowBegin, size_t rowEnd)
+		{
+			for (size_t r0 = rowBegin; r0 < rowEnd; r0 += Tile)
+			{
+				size_t r1 = std::min(rowEnd, r0 + Tile);
+				for (size_t c0 = 0; c0 < cols; c0 += Tile)
+				{
+					size_t c1 = std::min(cols, c0 + Tile);
+					for (size_t r = r0; r < r1; r++)
+					{
+						for (size_t c = c0; c < c1; c++)
+						{
+							dst[c * rows + r] = src[r * cols + c];
+						}
+					}
+				}
+			}
+		}
+
+		// Rows are handed out to the shared pool in whole tiles.
+		void parallelRows(size_t rows, const std::function<void(size_t, size_t)>& f)
+		{
+			ThreadPool::shared().parallelFor(0, (rows + Tile - 1) / Tile, 1, [&](size_t b, size_t e)
+			{
+				f(b * Tile, std::min(rows, e * Tile));
+			});
+		}
+	}
+
+	size_t Plan::sixStepMinSize()
+	{
+		return sixStepMinSizeSetting();
+	}
+
+	void Plan::setSixStepMinSize(size_t size)
+	{
+		sixStepMinSizeSetting() = size;
+	}
+
+	size_t Plan::parallelMinSize()
+	{
+		return parallelMinSizeSetting();
+	}
+
+	void Plan::setParallelMinSize(size_t size)
+	{
+		parallelMinSizeSetting() = size;
+	}
+
+	Plan::Plan(size_t size, bool inverse) : n(size), inv(inverse), powerOfTwo(false), vectorized(false), n1(0), n2(0), rows(NULL), columns(NULL)
+	{
+		double sign = (inverse) ? 1.0 : -1.0;
+
+		size_t r = n;
+		const size_t radixes[] = { 2, 3, 5 };
+		for (size_t i = 0; i < 3; i++)
+		{
+			while (r % radixes[i] == 0)
+			{
+				factors.push_back(radixes[i]);
+				r /= radixes[i];
+			}
+		}
+		assert(r == 1);
+
+		// n = n1 * n2 with n1 <= n2 as close as possible to sqrt(n), so both sub-transforms fit in cache.
+		// The sub-transforms are also what gets spread over threads. Every plan with two factors gets them,
+		// whether it runs six-step is decided at each call from the thread count (see sixStep).
+		if (factors.size() >= 2)
+		{
+			n1 = 1;
+			for (size_t i = factors.size(); i-- > 0; )
+			{
+				if (n1 * factors[i] * n1 * factors[i] <= n)
+				{
+					n1 *= factors[i];
+				}
+			}
+			n2 = n / n1;
+			rows = &Plan::get(n1, inverse);
+			columns = &Plan::get(n2, inverse);
+
+			// W^e = coarse[e / n1] * fine[e % n1], both factors computed directly
+			fineTwiddles.resize(n1);
+			for (size_t k = 0; k < n1; k++)
+			{
+				double angle = sign * pi2 * k / n;
+				fineTwiddles[k] = std::complex<double>(cos(angle), sin(angle));
+			}
+			coarseTwiddles.resize(n2 + 1);
+			for (size_t k = 0; k <= n2; k++)
+			{
+				double angle = sign * pi2 * (double) (k * n1) / n;
+				coarseTwiddles[k] = std::complex<double>(cos(angle), sin(angle));
+			}
+			if (n >= sixStepMinSize())
+			{
+				return;
+			}
 		}
 
-		for (int k = 0; k < log2n; ++k)
+		// every twiddle is computed directly, the recurrence used before drifted on large sizes
+		twiddles.resize(n);
+		for (size_t k = 0; k < twiddles.size(); k++)
 		{
-			n2 = n;
-			n <<= 1;
-			angle = (inverse)?pi2/n:-pi2/n;
-			wtmp=sin(0.5*angle);
-			wpr = -2.0*wtmp*wtmp;
-			wpi = sin(angle);
-			wr = 1.0;
-			wi = 0.0;
+			double angle = sign * pi2 * k / n;
+			twiddles[k] = std::complex<double>(cos(angle), sin(angle));
+		}
+
+		permutation.resize(n);
+		// digit reversal: the last stage combines sub-transforms of the samples with equal index modulo its radix
+		buildPermutation(0, 0, 1, factors.size(), n);
 
-			for (int m=0; m < n2; ++m)
+		// split radix-2 stages into pairs, each pair becomes one radix-4 pass with its own twiddle table
+		powerOfTwo = (n & (n - 1)) == 0;
+		vectorized = powerOfTwo && n >= VectorizedMinSize;
+		if (powerOfTwo)
+		{
+			for (size_t m = (factors.size() % 2 == 1) ? 2 : 1; m < n; m *= 4)
 			{
-				for (int i=m; i < size; i+=n)
+				size_t base = passTwiddles.size();
+				passTwiddles.resize(base + 4 * m);
+				for (size_t j = 0; j < m; j++)
 				{
-					int j = i+n2;
-					tc.real(wr * polynomial[j].real() - wi * polynomial[j].imag());
-					tc.imag(wr * polynomial[j].imag() + wi * polynomial[j].real());
-					polynomial[j] = polynomial[i] - tc;
-					polynomial[i] += tc;
+					const std::complex<double>& w1 = twiddles[j * (n / (2 * m))];
+					const std::complex<double>& w2 = twiddles[j * (n / (4 * m))];
+					passTwiddles[base + j] = w1.real();
+					passTwiddles[base + m + j] = w1.imag();
+					passTwiddles[base + 2 * m + j] = w2.real();
+					passTwiddles[base + 3 * m + j] = w2.imag();
 				}
-				wr=(wtmp=wr)*wpr-wi*wpi+wr;
-				wi=wi*wpr+wtmp*wpi+wi;
 			}
 		}
-		if(inverse)
+
+		std::vector<bool> visited(n, false);
+		for (size_t i = 0; i < n; i++)
 		{
-			for(int i = 0;i < n;i++)
+			if (visited[i] || permutation[i] == i)
 			{
-				polynomial[i] *= scale;
+				continue;
+			}
+			cycleStarts.push_back(i);
+			for (size_t j = i; !visited[j]; j = permutation[j])
+			{
+				visited[j] = true;
 			}
 		}
 	}
 
+	void Plan::buildPermutation(size_t offset, size_t start, size_t stride, size_t level, size_t count)
+	{
+		if (count == 1)
+		{
+			permutation[offset] = start;
+			return;
+		}
+
+		size_t p = factors[level - 1];
+		size_t m = count / p;
+		for (size_t r = 0; r < p; r++)
+		{
+			buildPermutation(offset + r * m, start + r * stride, stride * p, level - 1, m);
+		}
+	}
+
+	void Plan::execute(std::complex<double>* data) const
+	{
+		if (vectorized && !sixStep())
+		{
+			std::vector<double> buffer(2 * n);
+			execute(data, buffer.data());
+		}
+		else
+		{
+			execute(data, NULL);
+		}
+	}
+
+	bool Plan::sixStep() const
+	{
+		// plans from sixStepMinSize() have no tables for the direct transform
+		return rows != NULL && (twiddles.empty() || (n >= parallelMinSize() && ThreadPool::shared().size() > 1));
+	}
+
+	void Plan::execute(std::complex<double>* data, double* scratch) const
+	{
+		if (sixStep())
+		{
+			executeSixStep(data);
+			return;
+		}
+		if (vectorized)
+		{
+			executeVectorized(data, scratch);
+			return;
+		}
+
+		// permute in place, following each cycle of the permutation once
+		for (size_t c = 0; c < cycleStarts.size(); c++)
+		{
+			size_t s = cycleStarts[c];
+			std::complex<double> tmp = data[s];
+			size_t pos = s;
+			for (size_t src = permutation[pos]; src != s; src = permutation[pos])
+			{
+				data[pos] = data[src];
+				pos = src;
+			}
+			data[pos] = tmp;
+		}
+
+		size_t m = 1;
+		for (size_t f = 0; f < factors.size(); f++)
+		{
+			size_t p = factors[f];
+			switch (p)
+			{
+			case 2:  radix2(data, m); break;
+			case 3:  radix3(data, m); break;
+			default: radixGeneric(data, m, p); break;
+			}
+			m *= p;
+		}
+
+		if (inv)
+		{
+			double scale = 1.0 / n;
+			for (size_t i = 0; i < n; i++)
+			{
+				data[i] *= scale;
+			}
+		}
+	}
+
+	void Plan::executeBatch(std::complex<double>* data, size_t count, size_t stride, size_t distance) const
+	{
+		if (!powerOfTwo || sixStep() || n == 1)
+		{
+			// mixed radix and six-step plans take the transforms one by one through a contiguous copy
+			std::vector< std::complex<double> > one(n);
+			std::vector<double> scratch(vectorized ? 2 * n : 0);
+			for (size_t t = 0; t < count; t++)
+			{
+				std::complex<double>* transform = data + t * distance;
+				for (size_t k = 0; k < n; k++) one[k] = transform[k * stride];
+				execute(one.data(), scratch.data());
+				for (size_t k = 0; k < n; k++) transform[k * stride] = one[k];
+			}
+			return;
+		}
+
+		// groups of lanes transforms go through the kernels together, spread over the pool when there is enough work
+		size_t lanes = simd::batchLanes();
+		size_t groups = (count + lanes - 1) / lanes;
+		size_t grain = std::max<size_t>(1, parallelMinSize() / (n * lanes));
+		ThreadPool::shared().parallelFor(0, groups, grain, [&](size_t groupBegin, size_t groupEnd)
+		{
+			std::vector<double> buffer(2 * n * lanes);
+			for (size_t g = groupBegin; g < groupEnd; g++)
+			{
+				size_t first = g * lanes;
+				size_t used = std::min(lanes, count - first);
+				if (lanes == 8)
+				{
+					executeLanes<8>(data + first * distance, used, stride, distance, buffer.data());
+				}
+				else
+				{
+					executeLanes<4>(data + first * distance, used, stride, distance, buffer.data());
+				}
+			}
+		});
+	}
+
+	template<size_t Lanes>
+	void Plan::executeLanes(std::complex<double>* data, size_t used, size_t stride, size_t distance, double* scratch) const
+	{
+		double* re = scratch;
+		double* im = re + n * Lanes;
+		double scale = (inv) ? 1.0 / n : 1.0;
+
+		// missing transforms of the last group are zeros, full groups skip the check
+		if (used < Lanes)
+		{
+			std::fill(scratch, scratch + 2 * n * Lanes, 0.0);
+		}
+		for (size_t k = 0; k < n; k++)
+		{
+			const std::complex<double>* src = data + permutation[k] * stride;
+			if (used == Lanes)
+			{
+				for (size_t l = 0; l < Lanes; l++)
+				{
+					re[k * Lanes + l] = src[l * distance].real();
+					im[k * Lanes + l] = src[l * distance].imag();
+				}
+			}
+			else
+			{
+				for (size_t l = 0; l < used; l++)
+				{
+					re[k * Lanes + l] = src[l * distance].real();
+					im[k * Lanes + l] = src[l * distance].imag();
+				}
+			}
+		}
+
+		size_t m = 1;
+		if (factors.size() % 2 == 1)
+		{
+			simd::radix2FirstBatch(re, im, n, Lanes, (n == 2) ? scale : 1.0);
+			m = 2;
+		}
+		for (const double* tw = passTwiddles.data(); m < n; tw += 4 * m, m *= 4)
+		{
+			simd::radix4PassBatch(re, im, n, m, tw, inv, (m * 4 == n) ? scale : 1.0, Lanes);
+		}
+
+		for (size_t k = 0; k < n; k++)
+		{
+			std::complex<double>* dst = data + k * stride;
+			for (size_t l = 0; l < used; l++)
+			{
+				dst[l * distance] = std::complex<double>(re[k * Lanes + l], im[k * Lanes + l]);
+			}
+		}
+	}
+
+	// Bailey's six-step: the input is an n1 x n2 matrix (index j1 * n2 + j2), the output is read
+	// as n2 x n1 (index k1 + n1 * k2). Sub-plans of the same direction also take care of the 1/n.
+	void Plan::executeSixStep(std::complex<double>* data) const
+	{
+		std::vector< std::complex<double> > buffer(n);
+		std::complex<double>* tmp = buffer.data();
+
+		// 1, 2: columns become rows, transforms of length n1 over them
+		parallelRows(n1, [&](size_t b, size_t e) { transposeBlocked(data, tmp, n1, n2, b, e); });
+		ThreadPool::shared().parallelFor(0, n2, 1, [&](size_t b, size_t e)
+		{
+			std::vector<double> scratch(2 * n1);
+			for (size_t j2 = b; j2 < e; j2++)
+			{
+				rows->execute(tmp + j2 * n1, scratch.data());
+			}
+		});
+
+		// 3, 4: twiddle by W^(j2 k1) while transposing back, e = j2 k1 is split as q * n1 + r
+		parallelRows(n2, [&](size_t rowBegin, size_t rowEnd)
+		{
+			for (size_t r0 = rowBegin; r0 < rowEnd; r0 += Tile)
+			{
+				size_t r1 = std::min(rowEnd, r0 + Tile);
+				for (size_t c0 = 0; c0 < n1; c0 += Tile)
+				{
+					size_t c1 = std::min(n1, c0 + Tile);
+					for (size_t j2 = r0; j2 < r1; j2++)
+					{
+						size_t dq = j2 / n1, dr = j2 % n1;
+						size_t q = (j2 * c0) / n1, r = (j2 * c0) % n1;
+						for (size_t k1 = c0; k1 < c1; k1++)
+						{
+							data[k1 * n2 + j2] = tmp[j2 * n1 + k1] * (coarseTwiddles[q] * fineTwiddles[r]);
+							q += dq;
+							r += dr;
+							if (r >= n1)
+							{
+								r -= n1;
+								q++;
+							}
+						}
+					}
+				}
+			}
+		});
+
+		// 5, 6: transforms of length n2, then the final transpose into natural order
+		ThreadPool::shared().parallelFor(0, n1, 1, [&](size_t b, size_t e)
+		{
+			std::vector<double> scratch(2 * n2);
+			for (size_t k1 = b; k1 < e; k1++)
+			{
+				columns->execute(data + k1 * n2, scratch.data());
+			}
+		});
+		parallelRows(n1, [&](size_t b, size_t e) { transposeBlocked(data, tmp, n1, n2, b, e); });
+		ThreadPool::shared().parallelFor(0, n, Tile * Tile, [&](size_t b, size_t e)
+		{
+			std::copy(tmp + b, tmp + e, data + b);
+		});
+	}
+
+	void Plan::executeVectorized(std::complex<double>* data, double* scratch) const
+	{
+		// the bit reversal is done while splitting into re/im, the 1/n of the inverse in the last pass
+		double* re = scratch;
+		double* im = re + n;
+		for (size_t i = 0; i < n; i++)
+		{
+			const std::complex<double>& c = data[permutation[i]];
+			re[i] = c.real();
+			im[i] = c.imag();
+		}
+
+		double scale = (inv) ? 1.0 / n : 1.0;
+		size_t m = 1;
+		if (factors.size() % 2 == 1)
+		{
+			simd::radix2First(re, im, n, 1.0);
+			m = 2;
+		}
+		for (const double* tw = passTwiddles.data(); m < n; tw += 4 * m, m *= 4)
+		{
+			simd::radix4Pass(re, im, n, m, tw, inv, (m * 4 == n) ? scale : 1.0);
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			data[i] = std::complex<double>(re[i], im[i]);
+		}
+	}
+
+	// Each stage combines p sub-transforms of length m, stored at b + r*m, into one of length p*m.
+	void Plan::radix2(std::complex<double>* data, size_t m) const
+	{
+		std::complex<double> tc;
+		size_t step = n / (m << 1);
+		for (size_t j = 0; j < m; j++)
+		{
+			const std::complex<double>& w = twiddles[j * step];
+			for (size_t i = j; i < n; i += (m << 1))
+			{
+				size_t k = i + m;
+				tc.real(w.real() * data[k].real() - w.imag() * data[k].imag());
+				tc.imag(w.real() * data[k].imag() + w.imag() * data[k].real());
+				data[k] = data[i] - tc;
+				data[i] += tc;
+			}
+		}
+	}
+
+	void Plan::radix3(std::complex<double>* data, size_t m) const
+	{
+		// sin(2*pi/3) with the sign of the transform direction
+		const double s60 = (inv) ? 0.86602540378443864676 : -0.86602540378443864676;
+		size_t step = n / (m * 3);
+		for (size_t j = 0; j < m; j++)
+		{
+			const std::complex<double>& w1 = twiddles[j * step];
+			const std::complex<double>& w2 = twiddles[2 * j * step];
+			for (size_t i = j; i < n; i += m * 3)
+			{
+				std::complex<double> a0 = data[i];
+				std::complex<double> a1 = data[i + m] * w1;
+				std::complex<double> a2 = data[i + 2 * m] * w2;
+
+				std::complex<double> t1 = a1 + a2;
+				std::complex<double> t2 = a0 - 0.5 * t1;
+				std::complex<double> d = a1 - a2;
+				std::complex<double> t3(-s60 * d.imag(), s60 * d.real());
+
+				data[i] = a0 + t1;
+				data[i + m] = t2 + t3;
+				data[i + 2 * m] = t2 - t3;
+			}
+		}
+	}
+
+	void Plan::radixGeneric(std::complex<double>* data, size_t m, size_t p) const
+	{
+		const size_t MaxRadix = 5;
+		std::complex<double> a[MaxRadix];
+		assert(p <= MaxRadix);
+
+		size_t step = n / (m * p);
+		size_t rootStep = n / p;
+		for (size_t j = 0; j < m; j++)
+		{
+			for (size_t i = j; i < n; i += m * p)
+			{
+				for (size_t r = 0; r < p; r++)
+				{
+					a[r] = data[i + r * m] * twiddles[r * j * step];
+				}
+				for (size_t q = 0; q < p; q++)
+				{
+					std::complex<double> sum = a[0];
+					for (size_t r = 1; r < p; r++)
+					{
+						sum += a[r] * twiddles[((r * q) % p) * rootStep];
+					}
+					data[i + q * m] = sum;
+				}
+			}
+		}
+	}
+
+	const Plan& Plan::get(size_t size, bool inverse)
+	{
+		// recursive, six-step plans get their sub-plans while being built
+		static std::recursive_mutex cacheMutex;
+		static std::map<std::pair<size_t, bool>, std::unique_ptr<Plan>> cache;
+
+		std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+		std::unique_ptr<Plan>& plan = cache[std::make_pair(size, inverse)];
+		if (!plan)
+		{
+			plan.reset(new Plan(size, inverse));
+		}
+		return *plan;
+	}
+
+	RealPlan::RealPlan(size_t size) : n(size), halfDirect(Plan::get(size / 2, false)), halfInverse(Plan::get(size / 2, true)), twiddles(size / 2)
+	{
+		assert(n >= 2 && n % 2 == 0);
+
+		for (size_t k = 0; k < twiddles.size(); k++)
+		{
+			double angle = -pi2 * k / n;
+			twiddles[k] = std::complex<double>(cos(angle), sin(angle));
+		}
+	}
+
+	void RealPlan::direct(const double* in, size_t count, std::complex<double>* out) const
+	{
+		// even samples go to the real parts, odd samples to the imaginary parts
+		size_t m = n / 2;
+		double* packed = reinterpret_cast<double*>(out);
+		std::copy(in, in + count, packed);
+		std::fill(packed + count, packed + n, 0.0);
+		halfDirect.execute(out);
+
+		std::complex<double> z0 = out[0];
+		out[0] = z0.real() + z0.imag();
+		out[m] = z0.real() - z0.imag();
+
+		const std::complex<double> minusHalfI(0.0, -0.5);
+		for (size_t k = 1; k <= m / 2; k++)
+		{
+			std::complex<double> zk = out[k];
+			std::complex<double> zmk = out[m - k];
+
+			std::complex<double> even = 0.5 * (zk + std::conj(zmk));
+			std::complex<double> odd = minusHalfI * (zk - std::conj(zmk));
+			out[k] = even + twiddles[k] * odd;
+
+			// bin m - k uses the same pair, with W^(m-k) = -conj(W^k)
+			even = 0.5 * (zmk + std::conj(zk));
+			odd = minusHalfI * (zmk - std::conj(zk));
+			out[m - k] = even - std::conj(twiddles[k]) * odd;
+		}
+	}
+
+	void RealPlan::inverse(const std::complex<double>* in, double* out) const
+	{
+		size_t m = n / 2;
+		std::complex<double>* packed = reinterpret_cast<std::complex<double>*>(out);
+
+		const std::complex<double> i(0.0, 1.0);
+		for (size_t k = 0; k <= m / 2; k++)
+		{
+			std::complex<double> xk = in[k];
+			std::complex<double> xmk = in[m - k];
+
+			std::complex<double> even = 0.5 * (xk + std::conj(xmk));
+			std::complex<double> odd = 0.5 * (xk - std::conj(xmk)) * std::conj(twiddles[k]);
+			packed[k] = even + i * odd;
+
+			if (k != 0 && k != m - k)
+			{
+				even = 0.5 * (xmk + std::conj(xk));
+				odd = -0.5 * (xmk - std::conj(xk)) * twiddles[k];
+				packed[m - k] = even + i * odd;
+			}
+		}
+		halfInverse.execute(packed);
+	}
+
+	const RealPlan& RealPlan::get(size_t size)
+	{
+		static std::mutex cacheMutex;
+		static std::map<size_t, std::unique_ptr<RealPlan>> cache;
+
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		std::unique_ptr<RealPlan>& plan = cache[size];
+		if (!plan)
+		{
+			plan.reset(new RealPlan(size));
+		}
+		return *plan;
+	}
+
+	void transformInplace(PolynomialComplex& polynomial, bool inverse)
+	{
+		int size = (int) polynomial.size();
+		int log2n = 0, size2 = 1;
+		findPowOfToAndLog(size, size2, log2n);
+
+		if(size != size2)
+		{
+			polynomial.resize(size2);
+		}
+
+		Plan::get(size2, inverse).execute(polynomial.data());
+	}
+
+	void transformBatch(PolynomialComplex& batch, size_t size, bool inverse)
+	{
+		assert(size > 0 && batch.size() % size == 0);
+		Plan::get(size, inverse).executeBatch(batch.data(), batch.size() / size, 1, size);
+	}
+
 	void transformDirect(const Polynomial& polynomial, PolynomialComplex& outTransformed)
 	{
 		int n = polynomial.size();
 		int log2n, n2;
 		findPowOfToAndLog(n, n2, log2n);
 		outTransformed.resize(n2);
-		for(int i=0; i<n; i++)
+		if (n2 < 2)
+		{
+			// the empty polynomial transforms to a single zero, as before
+			outTransformed[0] = (n > 0) ? polynomial[0] : 0.0;
+			return;
+		}
+
+		// the upper half of the spectrum is the mirrored conjugate of the lower half
+		const RealPlan& plan = RealPlan::get(n2);
+		plan.direct(polynomial.data(), n, outTransformed.data());
+		for (int k = plan.bins(); k < n2; k++)
 		{
-			outTransformed[i] = polynomial[i];
+			outTransformed[k] = std::conj(outTransformed[n2 - k]);
 		}
-		transformInplace(outTransformed, false);
 	}
 
 	void transformInverse(const PolynomialComplex& polynomial, Polynomial& outTransformed)
@@ -90,9 +699,9 @@ namespace fft
 		{
 			tmp[i] = polynomial[i];
 		}
-		transformInplace(tmp, true);
+		Plan::get(n2, true).execute(tmp.data());
 		outTransformed.resize(n2);
-		for(int i=0; i<n; i++)
+		for(int i=0; i<n2; i++)
 		{
 			outTransformed[i] = tmp[i].real();
 		}
@@ -100,33 +709,81 @@ namespace fft
 
 	void multiply(const Polynomial& p1, const Polynomial& p2, Polynomial& outResult)
 	{
-		PolynomialComplex p1fft(p1.size());
-		for(size_t k = 0; k < p1.size(); k++)
+		if (p1.size() == 0 || p2.size() == 0)
 		{
-			p1fft[k] = p1[k];
+			outResult.resize(0);
+			return;
 		}
-		PolynomialComplex p2fft(p2.size());
-		for(size_t k = 0; k < p2.size(); k++)
+
+		// pad to the full product length so the cyclic convolution does not wrap around
+		size_t resultSize = p1.size() + p2.size() - 1;
+		size_t n = 2 * fastSize((resultSize + 1) / 2);
+		const RealPlan& plan = RealPlan::get(n);
+
+		PolynomialComplex p1fft(plan.bins());
+		PolynomialComplex p2fft(plan.bins());
+		if (n >= Plan::parallelMinSize() && ThreadPool::shared().size() > 1)
 		{
-			p2fft[k] = p2[k];
+			// both operands at once, each transform spreads further over the pool if it is large enough
+			ThreadPool::shared().parallelFor(0, 2, 1, [&](size_t b, size_t e)
+			{
+				for (size_t i = b; i < e; i++)
+				{
+					const Polynomial& p = (i == 0) ? p1 : p2;
+					plan.direct(p.data(), p.size(), (i == 0) ? p1fft.data() : p2fft.data());
+				}
+			});
+		}
+		else
+		{
+			plan.direct(p1.data(), p1.size(), p1fft.data());
+			plan.direct(p2.data(), p2.size(), p2fft.data());
 		}
-		fft::transformInplace(p1fft, false);
-		fft::transformInplace(p2fft, false);
-		outResult.resize(p1fft.size());
 		for(size_t k = 0; k < p1fft.size(); k++)
 		{
 			p1fft[k] = p1fft[k] * p2fft[k];
 		}
 
-		fft::transformInplace(p1fft, true);
+		outResult.resize(n);
+		plan.inverse(p1fft.data(), outResult.data());
+		outResult.resize(resultSize);
+	}
 
-		std::complex<double> c;
-		outResult.resize(p1fft.size());
-		for(size_t k = 0; k < p1fft.size(); k++)
+	void multiply(const PolynomialComplex& p1, const PolynomialComplex& p2, PolynomialComplex& outResult)
+	{
+		if (p1.size() == 0 || p2.size() == 0)
 		{
-			outResult[k] = p1fft[k].real();
+			outResult.resize(0);
+			return;
 		}
+
+		size_t resultSize = p1.size() + p2.size() - 1;
+		size_t n = fastSize(resultSize);
+
+		PolynomialComplex p1fft(n);
+		PolynomialComplex p2fft(n);
+		std::copy(p1.data(), p1.data() + p1.size(), p1fft.data());
+		std::copy(p2.data(), p2.data() + p2.size(), p2fft.data());
+		Plan::get(n, false).execute(p1fft.data());
+		Plan::get(n, false).execute(p2fft.data());
+		for (size_t k = 0; k < n; k++)
+		{
+			p1fft[k] = p1fft[k] * p2fft[k];
+		}
+		Plan::get(n, true).execute(p1fft.data());
+
+		p1fft.resize(resultSize);
+		outResult = std::move(p1fft);
 	}
 
 }
 
+void FastMultiply<double>::multiply(const Polynomial& p1, const Polynomial& p2, Polynomial& outResult)
+{
+	fft::multiply(p1, p2, outResult);
+}
+
+void FastMultiply< std::complex<double> >::multiply(const PolynomialComplex& p1, const PolynomialComplex& p2, PolynomialComplex& outResult)
+{
+	fft::multiply(p1, p2, outResult);
+}
@@ -4,11 +4,114 @@
 
 namespace fft
 {
+	// Smallest size >= minimum whose only prime factors are 2, 3 and 5.
+	size_t fastSize(size_t minimum);
+
+	// Precomputed twiddle factors and input permutation for one transform size and direction.
+	// Plans are immutable once built, get() hands out a cached instance per (size, direction).
+	class Plan
+	{
+	public:
+		Plan(size_t size, bool inverse);
+
+		size_t size() const    { return n; }
+		bool   inverse() const { return inv; }
+
+		// size() may only have 2, 3 and 5 as prime factors. Inverse plans also scale the result by 1/size().
+		void execute(std::complex<double>* data) const;
+
+		// Runs count transforms, value k of transform t is data[t * distance + k * stride].
+		// Contiguous transforms have stride 1 and distance size(), interleaved ones stride count and distance 1.
+		// Power of two sizes are vectorized across the transforms, which also pays off for very short ones.
+		void executeBatch(std::complex<double>* data, size_t count, size_t stride, size_t distance) const;
+
+		static const Plan& get(size_t size, bool inverse);
+
+		// Plans of at least this size run as a six-step transform over cache sized sub-plans.
+		// Changing it only affects plans built afterwards.
+		static size_t sixStepMinSize();
+		static void setSixStepMinSize(size_t size);
+
+		// When ThreadPool::shared() has more than one thread, plans and multiplications of at least this size
+		// are spread over it (plans by going six-step). Smaller ones stay on the calling thread.
+		// Both are read at each call, so changing them or the thread count also applies to cached plans.
+		static size_t parallelMinSize();
+		static void setParallelMinSize(size_t size);
+
+	private:
+		void buildPermutation(size_t offset, size_t start, size_t stride, size_t level, size_t count);
+
+		void radix2(std::complex<double>* data, size_t m) const;
+		void radix3(std::complex<double>* data, size_t m) const;
+		void radixGeneric(std::complex<double>* data, size_t m, size_t p) const;
+
+		// power of two plans from this size run the radix-4 kernels of fft_simd.h on split re/im arrays
+		static const size_t VectorizedMinSize = 64;
+		// scratch holds 2 * size() doubles, only used by vectorized plans
+		void execute(std::complex<double>* data, double* scratch) const;
+		void executeVectorized(std::complex<double>* data, double* scratch) const;
+
+		// true when this call runs executeSixStep rather than the direct transform
+		bool sixStep() const;
+		void executeSixStep(std::complex<double>* data) const;
+
+		// one group of up to Lanes transforms of a batch
+		template<size_t Lanes>
+		void executeLanes(std::complex<double>* data, size_t used, size_t stride, size_t distance, double* scratch) const;
+
+		size_t n;
+		bool inv;
+		bool powerOfTwo;
+		bool vectorized;
+		std::vector<double> passTwiddles;
+		std::vector<size_t> factors;
+		std::vector<size_t> permutation;
+		std::vector<size_t> cycleStarts;
+		std::vector< std::complex<double> > twiddles;
+
+		// plans with at least two factors, rows has size n1 and columns size n2
+		size_t n1, n2;
+		const Plan* rows;
+		const Plan* columns;
+		std::vector< std::complex<double> > fineTwiddles;
+		std::vector< std::complex<double> > coarseTwiddles;
+	};
+
+	// Transform of real input of even size, exploiting the Hermitian symmetry of the spectrum.
+	// Only the size()/2 + 1 non redundant bins are stored and a complex plan of half the size does the work.
+	class RealPlan
+	{
+	public:
+		RealPlan(size_t size);
+
+		size_t size() const    { return n; }
+		size_t bins() const    { return n / 2 + 1; }
+
+		// size() must be even, with size()/2 a valid Plan size.
+		// Reads count <= size() reals (the rest is zero padding) and writes bins() values to out.
+		void direct(const double* in, size_t count, std::complex<double>* out) const;
+
+		// Reads bins() values from in and writes size() reals to out, scaled by 1/size().
+		void inverse(const std::complex<double>* in, double* out) const;
+
+		static const RealPlan& get(size_t size);
+
+	private:
+		size_t n;
+		const Plan& halfDirect;
+		const Plan& halfInverse;
+		std::vector< std::complex<double> > twiddles;
+	};
+
 	void transformInplace(PolynomialComplex& polynomial, bool inverse);
 
+	// batch holds batch.size() / size contiguous transforms of length size, size must be a valid Plan size.
+	void transformBatch(PolynomialComplex& batch, size_t size, bool inverse);
+
 	void transformDirect(const Polynomial& polynomial, PolynomialComplex& outTransformed);
 
 	void transformInverse(const PolynomialComplex& polynomial, Polynomial& outTransformed);
 	
 	void multiply(const Polynomial& p1, const Polynomial& p2, Polynomial& outResult);
+	void multiply(const PolynomialComplex& p1, const PolynomialComplex& p2, PolynomialComplex& outResult);
 }
@@ -0,0 +1,335 @@
+#include "fft_simd.h"
+#include "cpu.h"
+
+namespace fft
+{
+	namespace simd
+	{
+		namespace
+		{
+			template<bool Scaled>
+			void radix4Scalar(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale)
+			{
+				const double* w1re = twiddles;
+				const double* w1im = twiddles + m;
+				const double* w2re = twiddles + 2 * m;
+				const double* w2im = twiddles + 3 * m;
+				// W^m of the pass is -i for the direct transform and i for the inverse one
+				double rot = (inverse) ? 1.0 : -1.0;
+
+				for (size_t b = 0; b < n; b += 4 * m)
+				{
+					for (size_t j = 0; j < m; j++)
+					{
+						size_t i0 = b + j, i1 = i0 + m, i2 = i1 + m, i3 = i2 + m;
+
+						double tr = w1re[j] * re[i1] - w1im[j] * im[i1];
+						double ti = w1re[j] * im[i1] + w1im[j] * re[i1];
+						double y0r = re[i0] + tr, y0i = im[i0] + ti;
+						double y1r = re[i0] - tr, y1i = im[i0] - ti;
+
+						tr = w1re[j] * re[i3] - w1im[j] * im[i3];
+						ti = w1re[j] * im[i3] + w1im[j] * re[i3];
+						double y2r = re[i2] + tr, y2i = im[i2] + ti;
+						double y3r = re[i2] - tr, y3i = im[i2] - ti;
+
+						tr = w2re[j] * y2r - w2im[j] * y2i;
+						ti = w2re[j] * y2i + w2im[j] * y2r;
+						double ur = w2re[j] * y3r - w2im[j] * y3i;
+						double ui = w2re[j] * y3i + w2im[j] * y3r;
+						double vr = -rot * ui, vi = rot * ur;
+
+						if (Scaled)
+						{
+							re[i0] = (y0r + tr) * scale; im[i0] = (y0i + ti) * scale;
+							re[i2] = (y0r - tr) * scale; im[i2] = (y0i - ti) * scale;
+							re[i1] = (y1r + vr) * scale; im[i1] = (y1i + vi) * scale;
+							re[i3] = (y1r - vr) * scale; im[i3] = (y1i - vi) * scale;
+						}
+						else
+						{
+							re[i0] = y0r + tr; im[i0] = y0i + ti;
+							re[i2] = y0r - tr; im[i2] = y0i - ti;
+							re[i1] = y1r + vr; im[i1] = y1i + vi;
+							re[i3] = y1r - vr; im[i3] = y1i - vi;
+						}
+					}
+				}
+			}
+
+			template<size_t Lanes>
+			void radix4BatchScalar(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale)
+			{
+				double rot = (inverse) ? 1.0 : -1.0;
+				for (size_t b = 0; b < n; b += 4 * m)
+				{
+					for (size_t j = 0; j < m; j++)
+					{
+						double w1r = twiddles[j], w1i = twiddles[m + j];
+						double w2r = twiddles[2 * m + j], w2i = twiddles[3 * m + j];
+						size_t i0 = (b + j) * Lanes, d = m * Lanes;
+						for (size_t l = i0; l < i0 + Lanes; l++)
+						{
+							size_t l1 = l + d, l2 = l1 + d, l3 = l2 + d;
+
+							double tr = w1r * re[l1] - w1i * im[l1];
+							double ti = w1r * im[l1] + w1i * re[l1];
+							double y0r = re[l] + tr, y0i = im[l] + ti;
+							double y1r = re[l] - tr, y1i = im[l] - ti;
+
+							tr = w1r * re[l3] - w1i * im[l3];
+							ti = w1r * im[l3] + w1i * re[l3];
+							double y2r = re[l2] + tr, y2i = im[l2] + ti;
+							double y3r = re[l2] - tr, y3i = im[l2] - ti;
+
+							tr = w2r * y2r - w2i * y2i;
+							ti = w2r * y2i + w2i * y2r;
+							double ur = w2r * y3r - w2i * y3i;
+							double ui = w2r * y3i + w2i * y3r;
+							double vr = -rot * ui, vi = rot * ur;
+
+							re[l] = (y0r + tr) * scale; im[l] = (y0i + ti) * scale;
+							re[l2] = (y0r - tr) * scale; im[l2] = (y0i - ti) * scale;
+							re[l1] = (y1r + vr) * scale; im[l1] = (y1i + vi) * scale;
+							re[l3] = (y1r - vr) * scale; im[l3] = (y1i - vi) * scale;
+						}
+					}
+				}
+			}
+
+#ifdef CPU_X86
+			// Radix-4 butterfly on the vectors at i0, i0 + d, i0 + 2d and i0 + 3d.
+			CPU_TARGET_AVX2
+			inline void butterflyAvx2(double* re, double* im, size_t i0, size_t d, __m256d ar, __m256d ai, __m256d br, __m256d bi, __m256d rot, __m256d s)
+			{
+				size_t i1 = i0 + d, i2 = i1 + d, i3 = i2 + d;
+
+				__m256d xr = _mm256_loadu_pd(re + i1), xi = _mm256_loadu_pd(im + i1);
+				__m256d tr = _mm256_fmsub_pd(ar, xr, _mm256_mul_pd(ai, xi));
+				__m256d ti = _mm256_fmadd_pd(ar, xi, _mm256_mul_pd(ai, xr));
+				xr = _mm256_loadu_pd(re + i0); xi = _mm256_loadu_pd(im + i0);
+				__m256d y0r = _mm256_add_pd(xr, tr), y0i = _mm256_add_pd(xi, ti);
+				__m256d y1r = _mm256_sub_pd(xr, tr), y1i = _mm256_sub_pd(xi, ti);
+
+				xr = _mm256_loadu_pd(re + i3); xi = _mm256_loadu_pd(im + i3);
+				tr = _mm256_fmsub_pd(ar, xr, _mm256_mul_pd(ai, xi));
+				ti = _mm256_fmadd_pd(ar, xi, _mm256_mul_pd(ai, xr));
+				xr = _mm256_loadu_pd(re + i2); xi = _mm256_loadu_pd(im + i2);
+				__m256d y2r = _mm256_add_pd(xr, tr), y2i = _mm256_add_pd(xi, ti);
+				__m256d y3r = _mm256_sub_pd(xr, tr), y3i = _mm256_sub_pd(xi, ti);
+
+				tr = _mm256_fmsub_pd(br, y2r, _mm256_mul_pd(bi, y2i));
+				ti = _mm256_fmadd_pd(br, y2i, _mm256_mul_pd(bi, y2r));
+				__m256d ur = _mm256_fmsub_pd(br, y3r, _mm256_mul_pd(bi, y3i));
+				__m256d ui = _mm256_fmadd_pd(br, y3i, _mm256_mul_pd(bi, y3r));
+				__m256d vr = _mm256_mul_pd(_mm256_sub_pd(_mm256_setzero_pd(), rot), ui);
+				__m256d vi = _mm256_mul_pd(rot, ur);
+
+				_mm256_storeu_pd(re + i0, _mm256_mul_pd(_mm256_add_pd(y0r, tr), s));
+				_mm256_storeu_pd(im + i0, _mm256_mul_pd(_mm256_add_pd(y0i, ti), s));
+				_mm256_storeu_pd(re + i2, _mm256_mul_pd(_mm256_sub_pd(y0r, tr), s));
+				_mm256_storeu_pd(im + i2, _mm256_mul_pd(_mm256_sub_pd(y0i, ti), s));
+				_mm256_storeu_pd(re + i1, _mm256_mul_pd(_mm256_add_pd(y1r, vr), s));
+				_mm256_storeu_pd(im + i1, _mm256_mul_pd(_mm256_add_pd(y1i, vi), s));
+				_mm256_storeu_pd(re + i3, _mm256_mul_pd(_mm256_sub_pd(y1r, vr), s));
+				_mm256_storeu_pd(im + i3, _mm256_mul_pd(_mm256_sub_pd(y1i, vi), s));
+			}
+
+			CPU_TARGET_AVX2
+			void radix4Avx2(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale)
+			{
+				const __m256d rot = _mm256_set1_pd((inverse) ? 1.0 : -1.0);
+				const __m256d s = _mm256_set1_pd(scale);
+				for (size_t b = 0; b < n; b += 4 * m)
+				{
+					for (size_t j = 0; j < m; j += 4)
+					{
+						butterflyAvx2(re, im, b + j, m,
+							_mm256_loadu_pd(twiddles + j), _mm256_loadu_pd(twiddles + m + j),
+							_mm256_loadu_pd(twiddles + 2 * m + j), _mm256_loadu_pd(twiddles + 3 * m + j), rot, s);
+					}
+				}
+			}
+
+			// 4 transforms side by side, one per lane, so the twiddles are broadcast
+			CPU_TARGET_AVX2
+			void radix4BatchAvx2(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale)
+			{
+				const __m256d rot = _mm256_set1_pd((inverse) ? 1.0 : -1.0);
+				const __m256d s = _mm256_set1_pd(scale);
+				for (size_t b = 0; b < n; b += 4 * m)
+				{
+					for (size_t j = 0; j < m; j++)
+					{
+						butterflyAvx2(re, im, (b + j) * 4, m * 4,
+							_mm256_set1_pd(twiddles[j]), _mm256_set1_pd(twiddles[m + j]),
+							_mm256_set1_pd(twiddles[2 * m + j]), _mm256_set1_pd(twiddles[3 * m + j]), rot, s);
+					}
+				}
+			}
+#endif
+
+#ifdef CPU_AVX512
+			// Radix-4 butterfly on the vectors at i0, i0 + d, i0 + 2d and i0 + 3d.
+			CPU_TARGET_AVX512
+			inline void butterflyAvx512(double* re, double* im, size_t i0, size_t d, __m512d ar, __m512d ai, __m512d br, __m512d bi, __m512d rot, __m512d s)
+			{
+				size_t i1 = i0 + d, i2 = i1 + d, i3 = i2 + d;
+
+				__m512d xr = _mm512_loadu_pd(re + i1), xi = _mm512_loadu_pd(im + i1);
+				__m512d tr = _mm512_fmsub_pd(ar, xr, _mm512_mul_pd(ai, xi));
+				__m512d ti = _mm512_fmadd_pd(ar, xi, _mm512_mul_pd(ai, xr));
+				xr = _mm512_loadu_pd(re + i0); xi = _mm512_loadu_pd(im + i0);
+				__m512d y0r = _mm512_add_pd(xr, tr), y0i = _mm512_add_pd(xi, ti);
+				__m512d y1r = _mm512_sub_pd(xr, tr), y1i = _mm512_sub_pd(xi, ti);
+
+				xr = _mm512_loadu_pd(re + i3); xi = _mm512_loadu_pd(im + i3);
+				tr = _mm512_fmsub_pd(ar, xr, _mm512_mul_pd(ai, xi));
+				ti = _mm512_fmadd_pd(ar, xi, _mm512_mul_pd(ai, xr));
+				xr = _mm512_loadu_pd(re + i2); xi = _mm512_loadu_pd(im + i2);
+				__m512d y2r = _mm512_add_pd(xr, tr), y2i = _mm512_add_pd(xi, ti);
+				__m512d y3r = _mm512_sub_pd(xr, tr), y3i = _mm512_sub_pd(xi, ti);
+
+				tr = _mm512_fmsub_pd(br, y2r, _mm512_mul_pd(bi, y2i));
+				ti = _mm512_fmadd_pd(br, y2i, _mm512_mul_pd(bi, y2r));
+				__m512d ur = _mm512_fmsub_pd(br, y3r, _mm512_mul_pd(bi, y3i));
+				__m512d ui = _mm512_fmadd_pd(br, y3i, _mm512_mul_pd(bi, y3r));
+				__m512d vr = _mm512_mul_pd(_mm512_sub_pd(_mm512_setzero_pd(), rot), ui);
+				__m512d vi = _mm512_mul_pd(rot, ur);
+
+				_mm512_storeu_pd(re + i0, _mm512_mul_pd(_mm512_add_pd(y0r, tr), s));
+				_mm512_storeu_pd(im + i0, _mm512_mul_pd(_mm512_add_pd(y0i, ti), s));
+				_mm512_storeu_pd(re + i2, _mm512_mul_pd(_mm512_sub_pd(y0r, tr), s));
+				_mm512_storeu_pd(im + i2, _mm512_mul_pd(_mm512_sub_pd(y0i, ti), s));
+				_mm512_storeu_pd(re + i1, _mm512_mul_pd(_mm512_add_pd(y1r, vr), s));
+				_mm512_storeu_pd(im + i1, _mm512_mul_pd(_mm512_add_pd(y1i, vi), s));
+				_mm512_storeu_pd(re + i3, _mm512_mul_pd(_mm512_sub_pd(y1r, vr), s));
+				_mm512_storeu_pd(im + i3, _mm512_mul_pd(_mm512_sub_pd(y1i, vi), s));
+			}
+
+			CPU_TARGET_AVX512
+			void radix4Avx512(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale)
+			{
+				const __m512d rot = _mm512_set1_pd((inverse) ? 1.0 : -1.0);
+				const __m512d s = _mm512_set1_pd(scale);
+				for (size_t b = 0; b < n; b += 4 * m)
+				{
+					for (size_t j = 0; j < m; j += 8)
+					{
+						butterflyAvx512(re, im, b + j, m,
+							_mm512_loadu_pd(twiddles + j), _mm512_loadu_pd(twiddles + m + j),
+							_mm512_loadu_pd(twiddles + 2 * m + j), _mm512_loadu_pd(twiddles + 3 * m + j), rot, s);
+					}
+				}
+			}
+
+			// 8 transforms side by side, one per lane, so the twiddles are broadcast
+			CPU_TARGET_AVX512
+			void radix4BatchAvx512(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale)
+			{
+				const __m512d rot = _mm512_set1_pd((inverse) ? 1.0 : -1.0);
+				const __m512d s = _mm512_set1_pd(scale);
+				for (size_t b = 0; b < n; b += 4 * m)
+				{
+					for (size_t j = 0; j < m; j++)
+					{
+						butterflyAvx512(re, im, (b + j) * 8, m * 8,
+							_mm512_set1_pd(twiddles[j]), _mm512_set1_pd(twiddles[m + j]),
+							_mm512_set1_pd(twiddles[2 * m + j]), _mm512_set1_pd(twiddles[3 * m + j]), rot, s);
+					}
+				}
+			}
+#endif
+		}
+
+		void radix2First(double* re, double* im, size_t n, double scale)
+		{
+			for (size_t i = 0; i < n; i += 2)
+			{
+				double ar = re[i], ai = im[i];
+				double br = re[i + 1], bi = im[i + 1];
+				re[i] = (ar + br) * scale;
+				im[i] = (ai + bi) * scale;
+				re[i + 1] = (ar - br) * scale;
+				im[i + 1] = (ai - bi) * scale;
+			}
+		}
+
+		void radix4Pass(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale)
+		{
+			// the vector kernels run over j, so the sub-transforms must be at least one register wide
+			cpu::Level level = cpu::current();
+#ifdef CPU_AVX512
+			if (level >= cpu::Avx512 && m % 8 == 0)
+			{
+				radix4Avx512(re, im, n, m, twiddles, inverse, scale);
+				return;
+			}
+#endif
+#ifdef CPU_X86
+			if (level >= cpu::Avx2 && m % 4 == 0)
+			{
+				radix4Avx2(re, im, n, m, twiddles, inverse, scale);
+				return;
+			}
+#endif
+			if (scale != 1.0)
+			{
+				radix4Scalar<true>(re, im, n, m, twiddles, inverse, scale);
+			}
+			else
+			{
+				radix4Scalar<false>(re, im, n, m, twiddles, inverse, scale);
+			}
+		}
+
+		size_t batchLanes()
+		{
+			cpu::Level level = cpu::current();
+			return (level >= cpu::Avx512) ? 8 : 4;
+		}
+
+		void radix2FirstBatch(double* re, double* im, size_t n, size_t lanes, double scale)
+		{
+			for (size_t i = 0; i < n * lanes; i += 2 * lanes)
+			{
+				for (size_t l = i; l < i + lanes; l++)
+				{
+					double ar = re[l], ai = im[l];
+					double br = re[l + lanes], bi = im[l + lanes];
+					re[l] = (ar + br) * scale;
+					im[l] = (ai + bi) * scale;
+					re[l + lanes] = (ar - br) * scale;
+					im[l + lanes] = (ai - bi) * scale;
+				}
+			}
+		}
+
+		void radix4PassBatch(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale, size_t lanes)
+		{
+			cpu::Level level = cpu::current();
+#ifdef CPU_AVX512
+			if (level >= cpu::Avx512 && lanes == 8)
+			{
+				radix4BatchAvx512(re, im, n, m, twiddles, inverse, scale);
+				return;
+			}
+#endif
+#ifdef CPU_X86
+			if (level >= cpu::Avx2 && lanes == 4)
+			{
+				radix4BatchAvx2(re, im, n, m, twiddles, inverse, scale);
+				return;
+			}
+#endif
+			if (lanes == 8)
+			{
+				radix4BatchScalar<8>(re, im, n, m, twiddles, inverse, scale);
+			}
+			else
+			{
+				radix4BatchScalar<4>(re, im, n, m, twiddles, inverse, scale);
+			}
+		}
+	}
+}
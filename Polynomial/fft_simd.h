@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+namespace fft
+{
+	// Structure of arrays butterfly kernels for power of two plans, with scalar, AVX2 and AVX-512 versions
+	// chosen by cpu::current().
+	// Data is split into re[] and im[], already in bit reversed order.
+	namespace simd
+	{
+		// First radix-2 stage (trivial twiddles) for plans with an odd log2(size).
+		void radix2First(double* re, double* im, size_t n, double scale);
+
+		// Two radix-2 stages in one pass over memory, combining sub-transforms of length m into length 4m.
+		// twiddles holds 4m values: re and im of W^(j n/2m), then re and im of W^(j n/4m), for j < m.
+		// Every output is multiplied by scale, used to fuse the 1/n of the inverse into the last pass.
+		void radix4Pass(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale);
+
+		// Batched versions vectorize across transforms instead of within one: lanes transforms are
+		// interleaved, value k of transform l is at re[k * lanes + l]. lanes is batchLanes(), 4 or 8.
+		size_t batchLanes();
+		void radix2FirstBatch(double* re, double* im, size_t n, size_t lanes, double scale);
+		void radix4PassBatch(double* re, double* im, size_t n, size_t m, const double* twiddles, bool inverse, double scale, size_t lanes);
+	}
+}
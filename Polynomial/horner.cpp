@@ -0,0 +1,145 @@
+#include "polynomial.h"
+#include "cpu.h"
+
+namespace
+{
+#ifdef CPU_X86
+	// 16 points per block in four vectors: four independent multiply-add chains cover the FMA latency,
+	// every coefficient is loaded once per block and broadcast to all lanes.
+	CPU_TARGET_AVX2 size_t hornerAvx2(const double* c, size_t n, const double* xs, size_t count, double* outValues)
+	{
+		size_t k = 0;
+		for (; k + 16 <= count; k += 16)
+		{
+			__m256d x0 = _mm256_loadu_pd(xs + k), x1 = _mm256_loadu_pd(xs + k + 4);
+			__m256d x2 = _mm256_loadu_pd(xs + k + 8), x3 = _mm256_loadu_pd(xs + k + 12);
+			__m256d a0 = _mm256_broadcast_sd(c + n - 1), a1 = a0, a2 = a0, a3 = a0;
+			for (size_t i = n - 1; i-- > 0;)
+			{
+				__m256d ci = _mm256_broadcast_sd(c + i);
+				a0 = _mm256_fmadd_pd(a0, x0, ci);
+				a1 = _mm256_fmadd_pd(a1, x1, ci);
+				a2 = _mm256_fmadd_pd(a2, x2, ci);
+				a3 = _mm256_fmadd_pd(a3, x3, ci);
+			}
+			_mm256_storeu_pd(outValues + k, a0);
+			_mm256_storeu_pd(outValues + k + 4, a1);
+			_mm256_storeu_pd(outValues + k + 8, a2);
+			_mm256_storeu_pd(outValues + k + 12, a3);
+		}
+		for (; k + 4 <= count; k += 4)
+		{
+			__m256d x = _mm256_loadu_pd(xs + k);
+			__m256d a = _mm256_broadcast_sd(c + n - 1);
+			for (size_t i = n - 1; i-- > 0;)
+			{
+				a = _mm256_fmadd_pd(a, x, _mm256_broadcast_sd(c + i));
+			}
+			_mm256_storeu_pd(outValues + k, a);
+		}
+		return k;
+	}
+
+	// One point, 16 coefficients per step: lane j of a[k] runs the Horner chain in x^16 of the coefficients
+	// 16 i + 4 k + j, so p(x) = sum of x^(4 k + j) a[k][j]. The coefficients above the last whole block start
+	// lane 0 of a[0] and get shifted up by the steps like any other.
+	CPU_TARGET_AVX2 double hornerOneAvx2(const double* c, size_t n, double x)
+	{
+		size_t blocks = n / 16;
+		double top = 0.0;
+		for (size_t i = n; i-- > 16 * blocks;)
+		{
+			top = top * x + c[i];
+		}
+
+		double x2 = x * x, x4 = x2 * x2, x8 = x4 * x4;
+		__m256d step = _mm256_set1_pd(x8 * x8);
+		__m256d a0 = _mm256_set_pd(0.0, 0.0, 0.0, top), a1 = _mm256_setzero_pd(), a2 = a1, a3 = a1;
+		for (size_t b = blocks; b-- > 0;)
+		{
+			const double* block = c + 16 * b;
+			a0 = _mm256_fmadd_pd(a0, step, _mm256_loadu_pd(block));
+			a1 = _mm256_fmadd_pd(a1, step, _mm256_loadu_pd(block + 4));
+			a2 = _mm256_fmadd_pd(a2, step, _mm256_loadu_pd(block + 8));
+			a3 = _mm256_fmadd_pd(a3, step, _mm256_loadu_pd(block + 12));
+		}
+
+		__m256d x4s = _mm256_set1_pd(x4);
+		__m256d sum = _mm256_fmadd_pd(_mm256_fmadd_pd(_mm256_fmadd_pd(a3, x4s, a2), x4s, a1), x4s, a0);
+		sum = _mm256_mul_pd(sum, _mm256_set_pd(x2 * x, x2, x, 1.0));
+		__m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+	}
+
+	// (ar + i ai) x + c on four points in structure of arrays form
+	CPU_TARGET_AVX2 inline void complexStep(__m256d& ar, __m256d& ai, __m256d xr, __m256d xi, __m256d cr, __m256d ci)
+	{
+		__m256d r = _mm256_fmadd_pd(ar, xr, _mm256_fnmadd_pd(ai, xi, cr));
+		ai = _mm256_fmadd_pd(ar, xi, _mm256_fmadd_pd(ai, xr, ci));
+		ar = r;
+	}
+
+	// Eight points per block. unpacklo/unpackhi of two vectors of interleaved values give the real and
+	// imaginary parts of points 0, 2, 1, 3, and the same two instructions restore the order at the end.
+	CPU_TARGET_AVX2 size_t hornerComplexAvx2(const std::complex<double>* c, size_t n, const std::complex<double>* xs, size_t count, std::complex<double>* outValues)
+	{
+		const double* coefficients = reinterpret_cast<const double*>(c);
+		size_t k = 0;
+		for (; k + 8 <= count; k += 8)
+		{
+			const double* x = reinterpret_cast<const double*>(xs + k);
+			__m256d v0 = _mm256_loadu_pd(x), v1 = _mm256_loadu_pd(x + 4), v2 = _mm256_loadu_pd(x + 8), v3 = _mm256_loadu_pd(x + 12);
+			__m256d xr0 = _mm256_unpacklo_pd(v0, v1), xi0 = _mm256_unpackhi_pd(v0, v1);
+			__m256d xr1 = _mm256_unpacklo_pd(v2, v3), xi1 = _mm256_unpackhi_pd(v2, v3);
+			__m256d ar0 = _mm256_broadcast_sd(coefficients + 2 * (n - 1)), ai0 = _mm256_broadcast_sd(coefficients + 2 * (n - 1) + 1);
+			__m256d ar1 = ar0, ai1 = ai0;
+			for (size_t i = n - 1; i-- > 0;)
+			{
+				__m256d cr = _mm256_broadcast_sd(coefficients + 2 * i), ci = _mm256_broadcast_sd(coefficients + 2 * i + 1);
+				complexStep(ar0, ai0, xr0, xi0, cr, ci);
+				complexStep(ar1, ai1, xr1, xi1, cr, ci);
+			}
+			double* out = reinterpret_cast<double*>(outValues + k);
+			_mm256_storeu_pd(out, _mm256_unpacklo_pd(ar0, ai0));
+			_mm256_storeu_pd(out + 4, _mm256_unpackhi_pd(ar0, ai0));
+			_mm256_storeu_pd(out + 8, _mm256_unpacklo_pd(ar1, ai1));
+			_mm256_storeu_pd(out + 12, _mm256_unpackhi_pd(ar1, ai1));
+		}
+		return k;
+	}
+#endif
+}
+
+size_t BatchHorner<double>::evaluate(const double* coefficients, size_t n, const double* xs, size_t count, double* outValues)
+{
+#ifdef CPU_X86
+	if (n > 0 && cpu::current() != cpu::Scalar)
+	{
+		return hornerAvx2(coefficients, n, xs, count, outValues);
+	}
+#endif
+	return 0;
+}
+
+bool BatchHorner<double>::evaluate(const double* coefficients, size_t n, const double& x, double& outValue)
+{
+#ifdef CPU_X86
+	if (n >= 16 && cpu::current() != cpu::Scalar)
+	{
+		outValue = hornerOneAvx2(coefficients, n, x);
+		return true;
+	}
+#endif
+	return false;
+}
+
+size_t BatchHorner< std::complex<double> >::evaluate(const std::complex<double>* coefficients, size_t n, const std::complex<double>* xs, size_t count, std::complex<double>* outValues)
+{
+#ifdef CPU_X86
+	if (n > 0 && cpu::current() != cpu::Scalar)
+	{
+		return hornerComplexAvx2(coefficients, n, xs, count, outValues);
+	}
+#endif
+	return 0;
+}
@@ -1,6 +1,17 @@
 #include "polynomial.h"
 #include "fft.h"
+#include "cpu.h"
+#include "ntt.h"
+#include "multipoint.h"
+#include "spectral.h"
+#include "convolver.h"
+#include "matrix.h"
+#include "factorization.h"
+#include "sparse.h"
+#include "tuning.h"
+#include <threadpool.h>
 #include <cassert>
+#include <cstring>
 #include <ctime>
 #include <iostream>
 
@@ -21,6 +32,17 @@ double endTimer(const char* msg)
 	return diff;
 }
 
+// all 64 bits random, four draws since RAND_MAX may be 32767
+uint64_t randomWord()
+{
+	uint64_t w = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		w = (w << 16) | (std::rand() & 0xffff);
+	}
+	return w;
+}
+
 void testPolynomialCalculate()
 {
 	double r;
@@ -36,6 +58,973 @@ void testPolynomialCalculate()
 	assert(r == 0.0);
 }
 
+void testEvaluation()
+{
+	// around the 16 coefficient blocks of the single point kernel
+	const size_t sizes[] = { 1, 3, 16, 17, 33, 100, 1000 };
+	const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+
+	for (size_t s = 0; s < count; s++)
+	{
+		size_t n = sizes[s];
+		Polynomial p(n);
+		for (size_t i = 0; i < n; i++) p[i] = (std::rand() % 200 - 100) / 100.0;
+
+		std::vector<double> xs(37), values(xs.size());
+		for (size_t k = 0; k < xs.size(); k++) xs[k] = (std::rand() % 200 - 100) / 100.0;
+		p.calculate(xs.data(), xs.size(), values.data());
+
+		for (size_t k = 0; k < xs.size(); k++)
+		{
+			double expected = 0.0, power = 1.0;
+			for (size_t i = 0; i < n; i++, power *= xs[k]) expected += p[i] * power;
+			assert(std::abs(p.calculate(xs[k]) - expected) < 1e-9 * (1.0 + std::abs(expected)));
+			assert(std::abs(values[k] - expected) < 1e-9 * (1.0 + std::abs(expected)));
+			cpu::setLevel(cpu::Scalar);
+			assert(std::abs(p.calculate(xs[k]) - expected) < 1e-9 * (1.0 + std::abs(expected)));
+			cpu::setLevel(cpu::detected());
+		}
+
+		// complex points go through their own kernel, 37 leaves a tail for the one by one path
+		PolynomialComplex pc(n);
+		for (size_t i = 0; i < n; i++) pc[i] = std::complex<double>(p[i], (std::rand() % 200 - 100) / 100.0);
+		std::vector< std::complex<double> > zs(37), complexValues(zs.size());
+		for (size_t k = 0; k < zs.size(); k++) zs[k] = std::polar(1.0, 0.1 * k);
+		pc.calculate(zs.data(), zs.size(), complexValues.data());
+		for (size_t k = 0; k < zs.size(); k++)
+		{
+			std::complex<double> expected = pc.calculate(zs[k]);
+			assert(std::abs(complexValues[k] - expected) < 1e-9 * (1.0 + std::abs(expected)));
+		}
+	}
+
+	// exact arithmetic modulo 2^64, the subproduct tree has to match Horner bit for bit
+	const size_t points[] = { 1, 32, 33, 100, 1000, 3000 };
+	for (size_t s = 0; s < sizeof(points) / sizeof(points[0]); s++)
+	{
+		size_t m = points[s];
+		for (size_t n = m / 2 + 1; n <= 2 * m + 1; n += m + 1)
+		{
+			PolynomialInteger p(n);
+			std::vector<uint64_t> xs(m), fast(m), direct(m);
+			for (size_t i = 0; i < n; i++) p[i] = randomWord();
+			for (size_t k = 0; k < m; k++) xs[k] = randomWord();
+
+			multipoint::evaluate(p, xs.data(), m, fast.data());
+			p.calculate(xs.data(), m, direct.data());
+			for (size_t k = 0; k < m; k++)
+			{
+				assert(fast[k] == direct[k]);
+			}
+		}
+	}
+
+	// in floating point the tree is only well conditioned for points spread around the unit circle,
+	// products of (x - x_i) over real points in [-1, 1] get exponentially large coefficients
+	const size_t complexPoints[] = { 40, 300, 2000 };
+	for (size_t s = 0; s < sizeof(complexPoints) / sizeof(complexPoints[0]); s++)
+	{
+		size_t m = complexPoints[s];
+		PolynomialComplex p(m);
+		std::vector< std::complex<double> > zs(m), fast(m), direct(m);
+		for (size_t i = 0; i < m; i++) p[i] = (std::rand() % 200 - 100) / 100.0;
+		for (size_t k = 0; k < m; k++) zs[k] = std::polar(1.0, 3.0 * k + 0.5);
+		multipoint::evaluate(p, zs.data(), m, fast.data());
+		p.calculate(zs.data(), m, direct.data());
+		for (size_t k = 0; k < m; k++)
+		{
+			assert(std::abs(fast[k] - direct[k]) < 1e-6 * (1.0 + std::abs(direct[k])));
+		}
+	}
+}
+
+void testInterpolation()
+{
+	const size_t sizes[] = { 1, 2, 20, 33, 300, 2000 };
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		size_t n = sizes[s];
+		PolynomialComplex p(n), q;
+		std::vector< std::complex<double> > zs(n), values(n);
+		for (size_t i = 0; i < n; i++) p[i] = std::complex<double>((std::rand() % 200 - 100) / 100.0, (std::rand() % 200 - 100) / 100.0);
+		for (size_t k = 0; k < n; k++) zs[k] = std::polar(1.0, 3.0 * k + 0.5);
+		p.calculate(zs.data(), n, values.data());
+
+		multipoint::interpolate(zs.data(), values.data(), n, q);
+		assert(q.size() == n);
+		for (size_t i = 0; i < n; i++)
+		{
+			// close points make the weights 1 / M'(x_i) large, the error grows with their number: up to 4e-5
+			// at 2000 points over 20 draws of the coefficients
+			assert(std::abs(q[i] - p[i]) < 1e-7 * n);
+		}
+	}
+
+	// a few real points
+	double xs[] = { -1.0, -0.5, 0.0, 0.25, 1.0, 2.0 };
+	double ys[] = { 3.0, 1.0, -2.0, 0.5, 4.0, -1.0 };
+	Polynomial p;
+	multipoint::interpolate(xs, ys, 6, p);
+	for (size_t k = 0; k < 6; k++)
+	{
+		assert(std::abs(p.calculate(xs[k]) - ys[k]) < 1e-10);
+	}
+}
+
+void testSpectral()
+{
+	Polynomial kernel(50), a(300), b(200), expected, t;
+	for (size_t i = 0; i < kernel.size(); i++) kernel[i] = (std::rand() % 200 - 100) / 100.0;
+	for (size_t i = 0; i < a.size(); i++) a[i] = (std::rand() % 200 - 100) / 100.0;
+	for (size_t i = 0; i < b.size(); i++) b[i] = (std::rand() % 200 - 100) / 100.0;
+
+	// ((a * kernel) * kernel + b) * kernel, transformed once each and back once
+	fft::SpectralPolynomial k(kernel, 500);
+	fft::SpectralPolynomial r(a, 500);
+	r *= k;
+	r *= k;
+	r += fft::SpectralPolynomial(b, 500);
+	r *= k;
+
+	a.multiplyNaive(kernel, t);
+	t.multiplyNaive(kernel, expected);
+	t = expected + b;
+	t.multiplyNaive(kernel, expected);
+
+	const Polynomial& c = r.coefficients();
+	assert(r.length() == expected.size() && c.size() == expected.size());
+	for (size_t i = 0; i < c.size(); i++)
+	{
+		assert(std::abs(c[i] - expected[i]) < 1e-8 * (1.0 + std::abs(expected[i])));
+	}
+
+	Polynomial direct;
+	k.multiply(b, direct);
+	b.multiplyNaive(kernel, expected);
+	assert(direct.size() == expected.size());
+	for (size_t i = 0; i < direct.size(); i++)
+	{
+		assert(std::abs(direct[i] - expected[i]) < 1e-9 * (1.0 + std::abs(expected[i])));
+	}
+
+	r -= r;
+	assert(std::abs(r.coefficients()[0]) < 1e-9);
+}
+
+// Hands out a byte buffer in reads of at most chunk bytes, to split samples across reads.
+class ChunkReader : public galib::io::IReader
+{
+public:
+	ChunkReader(const std::vector<double>& samples, size_t chunk) : data(reinterpret_cast<const char*>(samples.data())), size(samples.size() * sizeof(double)), idx(0), chunk(chunk) {}
+
+	size_t read(char* outData, size_t n)
+	{
+		size_t s = std::min(std::min(n, chunk), size - idx);
+		if (s == 0)
+		{
+			// data is null for an empty buffer, which memcpy may not get even for 0 bytes
+			return 0;
+		}
+		std::memcpy(outData, data + idx, s);
+		idx += s;
+		return s;
+	}
+
+private:
+	const char* data;
+	size_t size;
+	size_t idx;
+	size_t chunk;
+};
+
+void testConvolver()
+{
+	// kernel shorter and longer than the block
+	const size_t cases[][3] = { { 20000, 300, 1000 }, { 5000, 3000, 500 }, { 10, 7, 0 }, { 0, 5, 16 } };
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		size_t n = cases[c][0];
+		Polynomial kernel(cases[c][1]), input(n), expected;
+		for (size_t i = 0; i < kernel.size(); i++) kernel[i] = (std::rand() % 200 - 100) / 100.0;
+		for (size_t i = 0; i < n; i++) input[i] = (std::rand() % 200 - 100) / 100.0;
+
+		std::vector<double> samples(input.data(), input.data() + n);
+		ChunkReader reader(samples, 1001);
+		galib::io::StringWriter writer;
+		fft::StreamConvolver convolver(kernel, cases[c][2]);
+		size_t written = convolver.run(reader, writer);
+
+		assert(written == n + kernel.size() - 1);
+		assert(writer.buffer.size() == written * sizeof(double));
+		const double* out = reinterpret_cast<const double*>(writer.buffer.data());
+		if (n > 0)
+		{
+			input.multiplyNaive(kernel, expected);
+		}
+		for (size_t i = 0; i < written; i++)
+		{
+			double e = (i < expected.size()) ? expected[i] : 0.0;
+			assert(std::abs(out[i] - e) < 1e-9 * (1.0 + std::abs(e)));
+		}
+	}
+}
+
+void randomMatrix(size_t rows, size_t columns, Matrix& outMatrix)
+{
+	outMatrix.resize(rows, columns);
+	for (size_t i = 0; i < rows; i++)
+	{
+		for (size_t j = 0; j < columns; j++)
+		{
+			outMatrix(i, j) = (std::rand() % 200 - 100) / 100.0;
+		}
+	}
+}
+
+void testMatrix()
+{
+	// odd sizes to hit the partial tiles, large enough for several cache blocks
+	const size_t sizes[][3] = { { 1, 1, 1 }, { 7, 9, 5 }, { 13, 300, 17 }, { 100, 77, 260 }, { 150, 3100, 40 } };
+	const cpu::Level levels[] = { cpu::Scalar, cpu::detected() };
+	cpu::Level saved = cpu::current();
+
+	for (size_t l = 0; l < 2; l++)
+	{
+		cpu::setLevel(levels[l]);
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+		{
+			size_t n = sizes[s][0], k = sizes[s][1], m = sizes[s][2];
+			Matrix a, b, c;
+			randomMatrix(n, k, a);
+			randomMatrix(k, m, b);
+			a.multiply(b, c);
+			assert(c.rows() == n && c.columns() == m);
+			for (size_t i = 0; i < n; i++)
+			{
+				for (size_t j = 0; j < m; j++)
+				{
+					double e = 0.0;
+					for (size_t p = 0; p < k; p++) e += a(i, p) * b(p, j);
+					assert(std::abs(c(i, j) - e) < 1e-9 * (1.0 + std::abs(e)));
+				}
+			}
+
+			// C = 2 A B - C on top of the previous result
+			Matrix d(c);
+			gemm(n, m, k, 2.0, a.data(), a.stride(), b.data(), b.stride(), -1.0, d.data(), d.stride());
+			for (size_t i = 0; i < n; i++)
+			{
+				for (size_t j = 0; j < m; j++)
+				{
+					assert(std::abs(d(i, j) - c(i, j)) < 1e-9 * (1.0 + std::abs(c(i, j))));
+				}
+			}
+		}
+	}
+	cpu::setLevel(saved);
+
+	// strassen with tiny cutoffs, so that several levels and all the odd fixups run
+	const size_t shapes[][4] = { { 64, 64, 64, 8 }, { 97, 53, 130, 4 }, { 200, 201, 199, 16 }, { 33, 1, 40, 2 } };
+	for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++)
+	{
+		size_t n = shapes[s][0], k = shapes[s][1], m = shapes[s][2];
+		Matrix a, b, c, d;
+		randomMatrix(n, k, a);
+		randomMatrix(k, m, b);
+		a.multiply(b, c);
+		a.multiplyStrassen(b, d, shapes[s][3]);
+		assert(d.rows() == n && d.columns() == m);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = 0; j < m; j++)
+			{
+				assert(std::abs(d(i, j) - c(i, j)) < 1e-11 * k);
+			}
+		}
+	}
+
+	Matrix a, t;
+	randomMatrix(37, 70, a);
+	a.transpose(t);
+	assert(t.rows() == 70 && t.columns() == 37);
+	std::vector<double> x(70), y(37), z(70);
+	for (size_t j = 0; j < x.size(); j++) x[j] = (std::rand() % 200 - 100) / 100.0;
+	a.multiply(x.data(), y.data());
+	t.multiplyTransposed(x.data(), z.data());
+	for (size_t i = 0; i < 37; i++)
+	{
+		double e = 0.0;
+		for (size_t j = 0; j < 70; j++)
+		{
+			assert(t(j, i) == a(i, j));
+			e += a(i, j) * x[j];
+		}
+		assert(std::abs(y[i] - e) < 1e-12 && std::abs(z[i] - e) < 1e-12);
+	}
+
+	Matrix id = Matrix::identity(37), r;
+	id.multiply(a, r);
+	for (size_t i = 0; i < 37; i++)
+	{
+		for (size_t j = 0; j < 70; j++)
+		{
+			assert(r(i, j) == a(i, j));
+		}
+	}
+}
+
+// largest |a - b| over the common shape
+double maxDifference(const Matrix& a, const Matrix& b)
+{
+	double e = 0.0;
+	for (size_t i = 0; i < a.rows(); i++)
+	{
+		for (size_t j = 0; j < a.columns(); j++) e = std::max(e, std::abs(a(i, j) - b(i, j)));
+	}
+	return e;
+}
+
+void testFactorization()
+{
+	// sizes across the panel width so that the blocked updates run
+	const size_t sizes[] = { 1, 5, 64, 129, 300 };
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		size_t n = sizes[s];
+		Matrix a;
+		randomMatrix(n, n, a);
+		std::vector<double> x(n), b(n), solved(n);
+		for (size_t i = 0; i < n; i++) x[i] = (std::rand() % 200 - 100) / 100.0;
+		a.multiply(x.data(), b.data());
+
+		// P A = L U, rebuilt from the factors with the swaps undone in reverse
+		LU lu(a);
+		assert(!lu.singular());
+		Matrix l(n, n), u(n, n), product;
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				if (j < i) l(i, j) = lu.factors()(i, j); else u(i, j) = lu.factors()(i, j);
+			}
+			l(i, i) = 1.0;
+		}
+		l.multiply(u, product);
+		for (size_t k = n; k-- > 0;)
+		{
+			std::swap_ranges(product.row(k), product.row(k) + n, product.row(lu.pivots()[k]));
+		}
+		assert(maxDifference(product, a) < 1e-10 * n);
+		assert(a.solve(b.data(), solved.data()));
+		for (size_t i = 0; i < n; i++) assert(std::abs(solved[i] - x[i]) < 1e-8 * n);
+
+		// A A^T + n I is symmetric positive definite
+		Matrix t, spd;
+		a.transpose(t);
+		a.multiply(t, spd);
+		for (size_t i = 0; i < n; i++) spd(i, i) += n;
+		Cholesky cholesky(spd);
+		assert(cholesky.positiveDefinite());
+		cholesky.factor().transpose(t);
+		cholesky.factor().multiply(t, product);
+		assert(maxDifference(product, spd) < 1e-12 * n * n);
+		spd.multiply(x.data(), b.data());
+		assert(cholesky.solve(b.data(), solved.data()));
+		for (size_t i = 0; i < n; i++) assert(std::abs(solved[i] - x[i]) < 1e-10 * n);
+		if (n <= 64)
+		{
+			// larger determinants overflow
+			double relative = cholesky.determinant() / spd.determinant();
+			assert(std::abs(relative - 1.0) < 1e-9 * n);
+		}
+
+		// a tall system: Q^T Q = I, Q R = A and the least squares solution of a consistent system is exact
+		Matrix tall, q, r;
+		randomMatrix(n + 37, n, tall);
+		QR qr(tall);
+		qr.q(q);
+		qr.r(r);
+		q.multiply(r, product);
+		assert(maxDifference(product, tall) < 1e-12 * n);
+		q.transpose(t);
+		t.multiply(q, product);
+		assert(maxDifference(product, Matrix::identity(n)) < 1e-13 * n);
+		b.resize(n + 37);
+		tall.multiply(x.data(), b.data());
+		assert(qr.solve(b.data(), solved.data()));
+		for (size_t i = 0; i < n; i++) assert(std::abs(solved[i] - x[i]) < 1e-8 * n);
+	}
+
+	// determinants of a permuted triangular matrix and failures on singular and indefinite input
+	Matrix a(3, 3);
+	a(0, 1) = 2.0; a(0, 2) = 1.0;
+	a(1, 0) = 3.0; a(1, 1) = 1.0;
+	a(2, 2) = 4.0;
+	assert(std::abs(a.determinant() + 24.0) < 1e-12);
+	a(2, 2) = 0.0; a(2, 0) = 3.0; a(2, 1) = 1.0;
+	double b[3] = { 1.0, 2.0, 3.0 }, x[3];
+	assert(a.determinant() == 0.0 && !a.solve(b, x));
+	Matrix indefinite = Matrix::identity(3);
+	indefinite(1, 1) = -1.0;
+	assert(!Cholesky(indefinite).positiveDefinite());
+}
+
+void testSparse()
+{
+	// a few thousand triplets with repeated positions, sequentially and with threads for the parallel sort and products
+	const size_t counts[] = { 0, 1, 50, 200000 };
+	for (size_t threads = 1; threads <= 4; threads += 3)
+	{
+		ThreadPool::setThreadCount(threads);
+		for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+		{
+			size_t rows = 300, columns = 211 + c, count = counts[c];
+			std::vector<Triplet> triplets(count);
+			Matrix expected(rows, columns);
+			for (size_t p = 0; p < count; p++)
+			{
+				Triplet t = { std::rand() % rows, std::rand() % columns, (std::rand() % 200 - 100) / 100.0 };
+				triplets[p] = t;
+				expected(t.row, t.column) += t.value;
+			}
+			SparseMatrix a(rows, columns, triplets.data(), count);
+			assert(a.rows() == rows && a.columns() == columns && a.nonZeros() <= count);
+
+			Matrix dense;
+			a.toDense(dense);
+			for (size_t i = 0; i < rows; i++)
+			{
+				for (size_t j = 0; j < columns; j++)
+				{
+					assert(std::abs(dense(i, j) - expected(i, j)) < 1e-9 && a.at(i, j) == dense(i, j));
+				}
+			}
+
+			std::vector<double> x(columns), y(rows), z(columns), yDense(rows), zDense(columns);
+			for (size_t j = 0; j < columns; j++) x[j] = (std::rand() % 200 - 100) / 100.0;
+			a.multiply(x.data(), y.data());
+			dense.multiply(x.data(), yDense.data());
+			for (size_t i = 0; i < rows; i++) assert(std::abs(y[i] - yDense[i]) < 1e-9 * (1.0 + std::abs(yDense[i])));
+			a.multiplyTransposed(y.data(), z.data());
+			dense.multiplyTransposed(y.data(), zDense.data());
+			for (size_t j = 0; j < columns; j++) assert(std::abs(z[j] - zDense[j]) < 1e-9 * (1.0 + std::abs(zDense[j])));
+
+			SparseMatrix t;
+			a.transpose(t);
+			assert(t.rows() == columns && t.columns() == rows && t.nonZeros() == a.nonZeros());
+			t.multiply(y.data(), z.data());
+			for (size_t j = 0; j < columns; j++) assert(std::abs(z[j] - zDense[j]) < 1e-9 * (1.0 + std::abs(zDense[j])));
+		}
+	}
+	ThreadPool::setThreadCount(std::thread::hardware_concurrency());
+}
+
+void testDivision()
+{
+	// sizes on both sides of the long division cutoff and of the fft threshold
+	const size_t sizes[][2] = { { 10, 3 }, { 5, 7 }, { 100, 60 }, { 2000, 700 }, { 3000, 40 }, { 3000, 2999 }, { 5000, 2000 } };
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		size_t n = sizes[s][0], m = sizes[s][1];
+		Polynomial a(n), b(m), q, r, check;
+		for (size_t i = 0; i < n; i++) a[i] = (std::rand() % 200 - 100) / 100.0;
+		// a dominant leading coefficient keeps the division well conditioned
+		for (size_t i = 0; i < m; i++) b[i] = (std::rand() % 200 - 100) / (100.0 * m);
+		b[m - 1] = 2.0;
+
+		a.divmod(b, q, r);
+		assert(r.size() == m - 1 && q.size() == ((n >= m) ? n - m + 1 : 0));
+		check = q * b + r;
+		for (size_t i = 0; i < n; i++)
+		{
+			assert(std::abs(check.coefficient(i) - a[i]) < 1e-8);
+		}
+		for (size_t i = n; i < check.size(); i++)
+		{
+			assert(std::abs(check[i]) < 1e-8);
+		}
+
+		Polynomial r2;
+		a.mod(b, r2);
+		PolynomialModulus modulus(b);
+		Polynomial r3;
+		modulus.reduce(a, r3);
+		for (size_t i = 0; i < r.size(); i++)
+		{
+			assert(std::abs(r2[i] - r[i]) < 1e-8 && std::abs(r3[i] - r[i]) < 1e-8);
+		}
+	}
+
+	// power series inverse
+	Polynomial f(500), g, fg;
+	for (size_t i = 0; i < f.size(); i++) f[i] = (std::rand() % 200 - 100) / 50000.0;
+	f[0] = 1.5;
+	f.inverse(1000, g);
+	f.multiply(g, fg);
+	assert(g.size() == 1000 && std::abs(fg[0] - 1.0) < 1e-12);
+	for (size_t i = 1; i < 1000; i++)
+	{
+		assert(std::abs(fg[i]) < 1e-10);
+	}
+
+	// exact modulo 2^64 with an odd leading coefficient, with the default config and with every product
+	// above the NTT threshold, against long division
+	MultiplyConfig saved = MultiplyConfig::current();
+	PolynomialInteger a(1500), b(600), q, r;
+	for (size_t i = 0; i < a.size(); i++) a[i] = randomWord();
+	for (size_t i = 0; i < b.size(); i++) b[i] = randomWord();
+	b[b.size() - 1] |= 1;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		MultiplyConfig::current() = MultiplyConfig();
+		MultiplyConfig::current().divisionThreshold = (size_t) -1;
+		PolynomialInteger qLong, rLong;
+		a.divmod(b, qLong, rLong);
+
+		MultiplyConfig::current().divisionThreshold = 0;
+		if (pass == 1)
+		{
+			MultiplyConfig::current().nttThreshold = 0;
+		}
+		a.divmod(b, q, r);
+		assert(q.size() == qLong.size() && r.size() == rLong.size());
+		for (size_t i = 0; i < q.size(); i++) assert(q[i] == qLong[i]);
+		for (size_t i = 0; i < r.size(); i++) assert(r[i] == rLong[i]);
+
+		PolynomialInteger check = q * b + r;
+		assert(check.size() == a.size());
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			assert(check[i] == a[i]);
+		}
+	}
+
+	// products reduced against a fixed modulus agree with reducing the plain product, still with every
+	// product through the NTT
+	PolynomialIntegerModulus modulus(b);
+	PolynomialInteger x(599), y(599), xy, reduced, expected;
+	for (size_t i = 0; i < x.size(); i++) x[i] = randomWord();
+	for (size_t i = 0; i < y.size(); i++) y[i] = randomWord();
+	modulus.multiply(x, y, reduced);
+	x.multiply(y, xy);
+	xy.mod(b, expected);
+	assert(reduced.size() == expected.size());
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		assert(reduced[i] == expected[i]);
+	}
+	MultiplyConfig::current() = saved;
+}
+
+void testTransform(size_t N)
+{
+	const double pi2 = 3.14159265358979323846 * 2.0;
+
+	Polynomial p(N);
+	for (size_t i = 0; i < N; i++)
+	{
+		p[i] = 0.00001 * std::rand();
+	}
+
+	PolynomialComplex t;
+	fft::transformDirect(p, t);
+	for (size_t k = 0; k < N; k++)
+	{
+		std::complex<double> expected;
+		for (size_t i = 0; i < N; i++)
+		{
+			expected += p[i] * std::polar(1.0, -pi2 * ((i * k) % N) / N);
+		}
+		assert(std::abs(t[k] - expected) < 1e-9 * N);
+	}
+
+	Polynomial back;
+	fft::transformInverse(t, back);
+	for (size_t i = 0; i < N; i++)
+	{
+		assert(std::abs(back[i] - p[i]) < 1e-9);
+	}
+}
+
+void testTransform()
+{
+	// 512 goes through the radix-4 kernels, check every instruction set this CPU has
+	for (int level = cpu::Scalar; level <= cpu::detected(); level++)
+	{
+		cpu::setLevel((cpu::Level) level);
+		testTransform(16);
+		testTransform(512);
+	}
+	cpu::setLevel(cpu::detected());
+
+	// the empty polynomial gives a single zero
+	Polynomial empty;
+	PolynomialComplex t;
+	fft::transformDirect(empty, t);
+	assert(t.size() == 1 && t[0] == 0.0);
+}
+
+void testBatch()
+{
+	// 13 transforms leave a partial group of lanes, 12 goes through the mixed radix fallback
+	const size_t sizes[] = { 2, 8, 12, 64 };
+	const size_t count = 13;
+	for (size_t s = 0; s < 4; s++)
+	{
+		size_t n = sizes[s];
+		PolynomialComplex batch(n * count), interleaved(n * count);
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			batch[i] = std::complex<double>(0.00001 * std::rand(), 0.00001 * std::rand());
+			interleaved[(i % n) * count + i / n] = batch[i];
+		}
+
+		PolynomialComplex expected(batch);
+		for (size_t t = 0; t < count; t++)
+		{
+			fft::Plan::get(n, false).execute(expected.data() + t * n);
+		}
+		fft::transformBatch(batch, n, false);
+		fft::Plan::get(n, false).executeBatch(interleaved.data(), count, count, 1);
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			assert(std::abs(batch[i] - expected[i]) < 1e-9);
+			assert(std::abs(interleaved[(i % n) * count + i / n] - expected[i]) < 1e-9);
+		}
+	}
+}
+
+void testSixStep()
+{
+	// plans built directly skip the cache, so the lowered threshold does not leak into other tests
+	const size_t sizes[] = { 1800, 4096 };
+	for (size_t s = 0; s < 2; s++)
+	{
+		size_t n = sizes[s];
+		PolynomialComplex p(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			p[i] = std::complex<double>(0.00001 * std::rand(), 0.00001 * std::rand());
+		}
+
+		size_t oldMinSize = fft::Plan::sixStepMinSize();
+		fft::Plan direct(n, false);
+		fft::Plan::setSixStepMinSize(1024);
+		fft::Plan sixStep(n, false);
+		fft::Plan sixStepInverse(n, true);
+		fft::Plan::setSixStepMinSize(oldMinSize);
+
+		PolynomialComplex expected(p), t(p);
+		direct.execute(expected.data());
+		sixStep.execute(t.data());
+		for (size_t k = 0; k < n; k++)
+		{
+			assert(std::abs(t[k] - expected[k]) < 1e-9 * n);
+		}
+
+		sixStepInverse.execute(t.data());
+		for (size_t i = 0; i < n; i++)
+		{
+			assert(std::abs(t[i] - p[i]) < 1e-9);
+		}
+	}
+}
+
+void testParallel()
+{
+	size_t oldMinSize = fft::Plan::parallelMinSize();
+	fft::Plan::setParallelMinSize(1024);
+
+	const size_t n = 4096;
+	PolynomialComplex p(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		p[i] = std::complex<double>(0.00001 * std::rand(), 0.00001 * std::rand());
+	}
+
+	// one cached plan used with 4 threads (six-step), then with 1 (direct), then with 4 again
+	ThreadPool::setThreadCount(4);
+	const fft::Plan& cached = fft::Plan::get(n, false);
+	PolynomialComplex t(p);
+	cached.execute(t.data());
+
+	ThreadPool::setThreadCount(1);
+	PolynomialComplex direct(p), expected(p);
+	cached.execute(direct.data());
+	fft::Plan serial(n, false);
+	serial.execute(expected.data());
+	for (size_t k = 0; k < n; k++)
+	{
+		// the same direct transform, to the bit
+		assert(direct[k] == expected[k]);
+		assert(std::abs(t[k] - expected[k]) < 1e-9 * n);
+	}
+
+	ThreadPool::setThreadCount(4);
+	PolynomialComplex again(p);
+	cached.execute(again.data());
+	for (size_t k = 0; k < n; k++)
+	{
+		assert(again[k] == t[k]);
+	}
+
+	// the same product with 1 and with 4 threads
+	Polynomial p1(3000), p2(2000), rKaratsuba;
+	for (size_t i = 0; i < p1.size(); i++) p1[i] = 0.00001 * std::rand();
+	for (size_t i = 0; i < p2.size(); i++) p2[i] = 0.00001 * std::rand();
+	p1.multiplyKaratsuba(p2, rKaratsuba);
+	for (size_t threads = 1; threads <= 4; threads += 3)
+	{
+		ThreadPool::setThreadCount(threads);
+		Polynomial r;
+		fft::multiply(p1, p2, r);
+		assert(r.size() == rKaratsuba.size());
+		for (size_t i = 0; i < r.size(); i++)
+		{
+			assert(std::abs(r[i] - rKaratsuba[i]) < 1e-6 * (1.0 + std::abs(rKaratsuba[i])));
+		}
+	}
+
+	fft::Plan::setParallelMinSize(oldMinSize);
+	ThreadPool::setThreadCount(std::thread::hardware_concurrency());
+}
+
+void testMultiplicationSizes()
+{
+	const size_t sizes[] = { 1, 2, 3, 7, 10, 16, 45, 100 };
+	const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+
+	for (size_t a = 0; a < count; a++)
+	{
+		for (size_t b = 0; b < count; b++)
+		{
+			Polynomial p1(sizes[a]);
+			Polynomial p2(sizes[b]);
+			for (size_t i = 0; i < p1.size(); i++) p1[i] = 0.00001 * std::rand();
+			for (size_t i = 0; i < p2.size(); i++) p2[i] = 0.00001 * std::rand();
+
+			Polynomial rNaive, rFFT, rKaratsuba, rKaratsubaDeep, rAuto;
+			p1.multiplyNaive(p2, rNaive);
+			p1.multiply(p2, rAuto);
+			fft::multiply(p1, p2, rFFT);
+			p1.multiplyKaratsuba(p2, rKaratsuba);
+			p1.multiplyKaratsuba(p2, rKaratsubaDeep, 1);
+			assert(rFFT.size() == sizes[a] + sizes[b] - 1);
+			assert(rKaratsuba.size() == rFFT.size() && rKaratsubaDeep.size() == rFFT.size());
+			for (size_t i = 0; i < rFFT.size(); i++)
+			{
+				assert(std::abs(rFFT[i] - rNaive[i]) < 1e-6 * (1.0 + std::abs(rNaive[i])));
+				assert(std::abs(rKaratsuba[i] - rNaive[i]) < 1e-6 * (1.0 + std::abs(rNaive[i])));
+				assert(std::abs(rKaratsubaDeep[i] - rNaive[i]) < 1e-6 * (1.0 + std::abs(rNaive[i])));
+				assert(std::abs(rAuto[i] - rNaive[i]) < 1e-6 * (1.0 + std::abs(rNaive[i])));
+			}
+		}
+	}
+}
+
+void testIntegerMultiplication()
+{
+	const size_t sizes[] = { 1, 5, 64, 300, 400, 1000 };
+	const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+
+	for (size_t a = 0; a < count; a++)
+	{
+		for (size_t b = 0; b < count; b++)
+		{
+			// full 64 bit coefficients, the products wrap and must still match the naive product bit for bit
+			PolynomialInteger p1(sizes[a]);
+			PolynomialInteger p2(sizes[b]);
+			for (size_t i = 0; i < p1.size(); i++) p1[i] = randomWord();
+			for (size_t i = 0; i < p2.size(); i++) p2[i] = randomWord();
+			if (a == b)
+			{
+				// the worst case for the limb sums
+				std::fill(p1.data(), p1.data() + p1.size(), ~(uint64_t) 0);
+				std::fill(p2.data(), p2.data() + p2.size(), ~(uint64_t) 0);
+			}
+
+			PolynomialInteger rNaive, rNTT, rModulo, rAuto;
+			p1.multiplyNaive(p2, rNaive);
+			p1.multiply(p2, rAuto);
+			ntt::multiply(p1, p2, rNTT);
+			ntt::multiplyModulo(p1, p2, rModulo);
+			assert(rNTT.size() == rNaive.size() && rModulo.size() == rNaive.size());
+			for (size_t i = 0; i < rNaive.size(); i++)
+			{
+				assert(rNTT[i] == rNaive[i] && rAuto[i] == rNaive[i]);
+			}
+		}
+	}
+
+	// multiply picks the NTT from the threshold of the current config on, Karatsuba is exact modulo 2^64
+	size_t large = MultiplyConfig::current().nttThreshold + 100;
+	PolynomialInteger l1(large), l2(large + 37), rFast, rKaratsuba;
+	for (size_t i = 0; i < l1.size(); i++) l1[i] = randomWord();
+	for (size_t i = 0; i < l2.size(); i++) l2[i] = randomWord();
+	l1.multiply(l2, rFast);
+	l1.multiplyKaratsuba(l2, rKaratsuba);
+	assert(rFast.size() == rKaratsuba.size());
+	for (size_t i = 0; i < rFast.size(); i++)
+	{
+		assert(rFast[i] == rKaratsuba[i]);
+	}
+
+	PolynomialInteger p1(3), p2(2), r;
+	p1[0] = 1; p1[1] = 2; p1[2] = 3;
+	p2[0] = ntt::Prime1 - 1; p2[1] = 1;
+	ntt::multiplyModulo(p1, p2, r);
+	assert(r[0] == ntt::Prime1 - 1 && r[1] == ntt::Prime1 - 1 && r[2] == ntt::Prime1 - 1 && r[3] == 3);
+}
+
+void testExpressions()
+{
+	Polynomial a(40), b(300), c(300), d(7);
+	for (size_t i = 0; i < a.size(); i++) a[i] = (std::rand() % 100) / 10.0;
+	for (size_t i = 0; i < b.size(); i++) b[i] = (std::rand() % 100) / 10.0;
+	for (size_t i = 0; i < c.size(); i++) c[i] = (std::rand() % 100) / 10.0;
+	for (size_t i = 0; i < d.size(); i++) d[i] = (std::rand() % 100) / 10.0;
+
+	Polynomial bc, sum, expected;
+	b.multiplyNaive(c, bc);
+	a.add(bc, sum);
+	expected = sum;
+	for (size_t i = 0; i < d.size(); i++) expected[i] -= d[i];
+
+	Polynomial r = a + b * c - d;
+	assert(r.size() == expected.size());
+	for (size_t i = 0; i < r.size(); i++)
+	{
+		assert(std::abs(r[i] - expected[i]) < 1e-6 * (1.0 + std::abs(expected[i])));
+	}
+
+	r = 2.0 * a - (-a);
+	assert(r.size() == a.size());
+	for (size_t i = 0; i < r.size(); i++) assert(r[i] == 3.0 * a[i]);
+
+	// the result aliases an operand
+	Polynomial s = a;
+	s = s + b;
+	s -= b;
+	assert(s.size() == b.size());
+	for (size_t i = 0; i < a.size(); i++) assert(std::abs(s[i] - a[i]) < 1e-9);
+
+	s = a;
+	s = s * s;
+	Polynomial aa;
+	a.multiplyNaive(a, aa);
+	assert(s.size() == aa.size());
+	for (size_t i = 0; i < s.size(); i++) assert(std::abs(s[i] - aa[i]) < 1e-6 * (1.0 + aa[i]));
+
+	PolynomialInteger x(3), y(2);
+	x[0] = 1; x[1] = 2; x[2] = 3;
+	y[0] = 4; y[1] = 5;
+	PolynomialInteger z = (x + y) * y;
+	assert(z.size() == 4 && z[0] == 20 && z[1] == 53 && z[2] == 47 && z[3] == 15);
+}
+
+// Counts the allocations that reach it, stands in for an arena or pool allocator.
+static size_t _allocations = 0;
+
+template<typename T>
+struct CountingAllocator
+{
+	typedef T value_type;
+	template<typename U> struct rebind { typedef CountingAllocator<U> other; };
+
+	CountingAllocator() {}
+	template<typename U> CountingAllocator(const CountingAllocator<U>&) {}
+
+	T* allocate(size_t n)               { _allocations++; return std::allocator<T>().allocate(n); }
+	void deallocate(T* p, size_t n)     { std::allocator<T>().deallocate(p, n); }
+
+	template<typename U> bool operator==(const CountingAllocator<U>&) const { return true; }
+	template<typename U> bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+void testStorage()
+{
+	typedef TPolynomial< double, CountingAllocator<double> > CountedPolynomial;
+
+	// low degree polynomials live inside the object
+	_allocations = 0;
+	CountedPolynomial r;
+	for (int k = 0; k < 1000; k++)
+	{
+		CountedPolynomial a(2), b(3);
+		a[0] = k; a[1] = 1;
+		b[0] = 1; b[1] = 2; b[2] = 3;
+		r = a * b + b;
+	}
+	assert(_allocations == 0);
+	assert(r.size() == 4 && r[0] == 999 + 1 && r[3] == 3);
+
+	// a product is multiplied into the result's storage, further ones take a temporary, and expression operands
+	// of a product are evaluated with the operands' allocator
+	CountedPolynomial a(20), b(20), c(20), d(20);
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		a[i] = (double) i; b[i] = 1.0; c[i] = 2.0 * i; d[i] = 3.0;
+	}
+	_allocations = 0;
+	CountedPolynomial e = a + b * c - d;
+	assert(_allocations == 1 && e.size() == 39);
+	_allocations = 0;
+	CountedPolynomial f = a * b + 2.0 * (c * d);
+	assert(_allocations == 2 && f.size() == 39);
+	_allocations = 0;
+	CountedPolynomial g = (a + b) * c;
+	assert(_allocations == 2 && g.size() == 39);
+	CountedPolynomial bc, ab, cd, sum, sumc;
+	b.multiplyNaive(c, bc);
+	a.multiplyNaive(b, ab);
+	c.multiplyNaive(d, cd);
+	a.add(b, sum);
+	sum.multiplyNaive(c, sumc);
+	for (size_t i = 0; i < 39; i++)
+	{
+		assert(e[i] == bc[i] + a.coefficient(i) - d.coefficient(i));
+		assert(f[i] == ab[i] + 2.0 * cd[i] && g[i] == sumc[i]);
+	}
+
+	// moving a large polynomial hands over its buffer
+	CountedPolynomial big(1000);
+	for (size_t i = 0; i < big.size(); i++) big[i] = (double) i;
+	const double* buffer = big.data();
+	_allocations = 0;
+	CountedPolynomial moved(std::move(big));
+	assert(_allocations == 0 && moved.data() == buffer && moved.size() == 1000 && big.size() == 0);
+	CountedPolynomial assigned;
+	assigned = std::move(moved);
+	assert(_allocations == 0 && assigned.data() == buffer && assigned[999] == 999.0);
+
+	// small ones are moved element by element and stay usable
+	Polynomial small(3);
+	small[0] = 1; small[1] = 2; small[2] = 3;
+	Polynomial copy(small);
+	Polynomial other(std::move(small));
+	assert(other.size() == 3 && other[2] == 3 && small.size() == 0);
+	small = other;
+	assert(small.size() == 3 && copy[1] == small[1]);
+
+	// the fill value may live in the buffer that growing frees
+	Polynomial grown(20);
+	for (size_t i = 0; i < grown.size(); i++) grown[i] = (double) i;
+	grown.resize(1000, grown[5]);
+	assert(grown.size() == 1000 && grown[19] == 19.0 && grown[20] == 5.0 && grown[999] == 5.0);
+
+	// the transform path is taken with a custom allocator too
+	CountedPolynomial p1(600), p2(600), rFast, rNaive;
+	for (size_t i = 0; i < p1.size(); i++) p1[i] = (std::rand() % 100) / 10.0;
+	for (size_t i = 0; i < p2.size(); i++) p2[i] = (std::rand() % 100) / 10.0;
+	p1.multiply(p2, rFast);
+	p1.multiplyNaive(p2, rNaive);
+	assert(rFast.size() == rNaive.size());
+	for (size_t i = 0; i < rNaive.size(); i++)
+	{
+		assert(std::abs(rFast[i] - rNaive[i]) < 1e-6 * (1.0 + rNaive[i]));
+	}
+}
+
 void testMultiplication()
 {
 	const size_t NR_TESTS = 50;
@@ -78,12 +1067,358 @@ void testMultiplication()
 	endTimer("FFT polynomial multiplication");
 }
 
+// Time per product for each algorithm, to find where Karatsuba and FFT start to pay off.
+void benchmarkMultiplication()
+{
+	const size_t sizes[] = { 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+	const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+
+	std::cout << "size\tnaive(ms)\tkaratsuba(ms)\tfft(ms)\tauto(ms)" << std::endl;
+	for (size_t s = 0; s < count; s++)
+	{
+		size_t n = sizes[s];
+		size_t repeat = std::max<size_t>(1, (1 << 20) / (n * n));
+
+		Polynomial p1(n), p2(n), r;
+		for (size_t i = 0; i < n; i++)
+		{
+			p1[i] = 0.00001 * std::rand();
+			p2[i] = 0.00001 * std::rand();
+		}
+
+		// the first transform of a size builds its plans
+		fft::multiply(p1, p2, r);
+
+		std::clock_t start = std::clock();
+		for (size_t j = 0; j < repeat; j++) p1.multiplyNaive(p2, r);
+		double naive = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / repeat;
+
+		start = std::clock();
+		for (size_t j = 0; j < repeat; j++) p1.multiplyKaratsuba(p2, r);
+		double karatsuba = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / repeat;
+
+		start = std::clock();
+		for (size_t j = 0; j < repeat; j++) fft::multiply(p1, p2, r);
+		double transform = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / repeat;
+
+		start = std::clock();
+		for (size_t j = 0; j < repeat; j++) p1.multiply(p2, r);
+		double automatic = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / repeat;
+
+		std::cout << n << "\t" << naive << "\t" << karatsuba << "\t" << transform << "\t" << automatic << std::endl;
+	}
+}
+
+void benchmarkEvaluation()
+{
+	std::cout << "points\thorner(ms)\tbatch(ms)\tmultipoint(ms)\tinterpolate(ms)" << std::endl;
+	for (size_t n = 1 << 10; n <= (1 << 16); n *= 4)
+	{
+		PolynomialComplex p(n);
+		std::vector< std::complex<double> > zs(n), values(n);
+		for (size_t i = 0; i < n; i++) p[i] = (std::rand() % 200 - 100) / 100.0;
+		for (size_t k = 0; k < n; k++) zs[k] = std::polar(1.0, 3.0 * k + 0.5);
+
+		std::clock_t start = std::clock();
+		for (size_t k = 0; k < n; k++) values[k] = p.calculate(zs[k]);
+		double horner = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+
+		start = std::clock();
+		p.calculate(zs.data(), n, values.data());
+		double batch = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+
+		start = std::clock();
+		multipoint::evaluate(p, zs.data(), n, values.data());
+		double fast = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+
+		PolynomialComplex q;
+		start = std::clock();
+		multipoint::interpolate(zs.data(), values.data(), n, q);
+		double back = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+
+		std::cout << n << "\t" << horner << "\t" << batch << "\t" << fast << "\t" << back << std::endl;
+	}
+}
+
+void benchmarkSpectral()
+{
+	std::cout << "kernel\tfft(ms)\tspectral(ms)" << std::endl;
+	for (size_t n = 1 << 8; n <= (1 << 14); n *= 4)
+	{
+		size_t repeat = std::max<size_t>(1, (1 << 22) / (n * 16));
+		Polynomial kernel(n), p(n), r;
+		for (size_t i = 0; i < n; i++)
+		{
+			kernel[i] = 0.00001 * std::rand();
+			p[i] = 0.00001 * std::rand();
+		}
+		fft::SpectralPolynomial spectral(kernel, 2 * n - 1);
+		fft::multiply(kernel, p, r);
+
+		std::clock_t start = std::clock();
+		for (size_t j = 0; j < repeat; j++) fft::multiply(kernel, p, r);
+		double transform = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / repeat;
+
+		start = std::clock();
+		for (size_t j = 0; j < repeat; j++) spectral.multiply(p, r);
+		double cached = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / repeat;
+
+		std::cout << n << "\t" << transform << "\t" << cached << std::endl;
+	}
+}
+
+// Endless source of samples and a sink, to stream more than would fit in memory at once.
+class NoiseReader : public galib::io::IReader
+{
+public:
+	NoiseReader(size_t samples) : left(samples * sizeof(double)) {}
+
+	size_t read(char* outData, size_t n)
+	{
+		size_t s = std::min(n, left) / sizeof(double);
+		double* out = reinterpret_cast<double*>(outData);
+		for (size_t i = 0; i < s; i++) out[i] = 0.00001 * std::rand();
+		left -= s * sizeof(double);
+		return s * sizeof(double);
+	}
+
+private:
+	size_t left;
+};
+
+class NullWriter : public galib::io::IWriter
+{
+public:
+	void write(const char*, size_t) {}
+};
+
+void benchmarkConvolver()
+{
+	const size_t samples = 1 << 24;
+	std::cout << "kernel\tblock\tMsamples/s" << std::endl;
+	for (size_t k = 1 << 6; k <= (1 << 14); k *= 16)
+	{
+		Polynomial kernel(k);
+		for (size_t i = 0; i < k; i++) kernel[i] = 0.00001 * std::rand();
+		fft::StreamConvolver convolver(kernel);
+		NoiseReader reader(samples);
+		NullWriter writer;
+
+		std::clock_t start = std::clock();
+		convolver.run(reader, writer);
+		double seconds = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+		std::cout << k << "\t" << convolver.blockSize() << "\t" << samples / seconds / 1e6 << std::endl;
+	}
+}
+
+void benchmarkMatrix()
+{
+	std::cout << "size\tnaive(GFlop/s)\tgemm(GFlop/s)" << std::endl;
+	for (size_t n = 128; n <= 2048; n *= 2)
+	{
+		Matrix a, b, c;
+		randomMatrix(n, n, a);
+		randomMatrix(n, n, b);
+		double flops = 2.0 * n * n * n;
+
+		double naive = 0.0;
+		if (n <= 512)
+		{
+			c.resize(n, n);
+			std::clock_t start = std::clock();
+			for (size_t i = 0; i < n; i++)
+			{
+				for (size_t p = 0; p < n; p++)
+				{
+					double aip = a(i, p);
+					for (size_t j = 0; j < n; j++) c(i, j) += aip * b(p, j);
+				}
+			}
+			naive = flops / ((double) (std::clock() - start) / CLOCKS_PER_SEC) / 1e9;
+		}
+
+		std::clock_t start = std::clock();
+		a.multiply(b, c);
+		double blocked = flops / ((double) (std::clock() - start) / CLOCKS_PER_SEC) / 1e9;
+
+		std::cout << n << "\t";
+		if (naive > 0.0) std::cout << naive; else std::cout << "-";
+		std::cout << "\t" << blocked << std::endl;
+	}
+}
+
+void benchmarkStrassen()
+{
+	// gemm against strassen at a few cutoffs on 4k to 16k, the crossover is where a level starts to pay for
+	// its additions. 16k takes about 6 GB for the operands, the result and the workspace
+	const size_t cutoffs[] = { 512, 1024, 2048 };
+	std::cout << "size\tgemm(s)\tstrassen 512(s)\tstrassen 1024(s)\tstrassen 2048(s)" << std::endl;
+	for (size_t n = 4096; n <= 16384; n *= 2)
+	{
+		Matrix a, b, c;
+		randomMatrix(n, n, a);
+		randomMatrix(n, n, b);
+
+		std::clock_t start = std::clock();
+		a.multiply(b, c);
+		std::cout << n << "\t" << (double) (std::clock() - start) / CLOCKS_PER_SEC;
+		for (size_t i = 0; i < sizeof(cutoffs) / sizeof(cutoffs[0]); i++)
+		{
+			start = std::clock();
+			a.multiplyStrassen(b, c, cutoffs[i]);
+			std::cout << "\t" << (double) (std::clock() - start) / CLOCKS_PER_SEC;
+		}
+		std::cout << std::endl;
+	}
+}
+
+void benchmarkSparse()
+{
+	// about 8 entries per row of a million columns, 99.999% zeros
+	const size_t n = 1000000, perRow = 8;
+	std::vector<Triplet> triplets(n * perRow);
+	for (size_t p = 0; p < triplets.size(); p++)
+	{
+		// two draws per index since RAND_MAX may be 32767
+		size_t row = ((size_t) std::rand() * RAND_MAX + std::rand()) % n;
+		size_t column = ((size_t) std::rand() * RAND_MAX + std::rand()) % n;
+		Triplet t = { row, column, 1.0 };
+		triplets[p] = t;
+	}
+	std::clock_t start = std::clock();
+	SparseMatrix a(n, n, triplets.data(), triplets.size());
+	double build = (double) (std::clock() - start) / CLOCKS_PER_SEC;
+
+	std::vector<double> x(n, 1.0), y(n);
+	const int runs = 20;
+	cpu::Level saved = cpu::current();
+	std::cout << "build(s)\tspmv scalar(ms)\tspmv(ms)\ttransposed(ms)" << std::endl << build;
+	cpu::setLevel(cpu::Scalar);
+	start = std::clock();
+	for (int r = 0; r < runs; r++) a.multiply(x.data(), y.data());
+	std::cout << "\t" << 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / runs;
+	cpu::setLevel(saved);
+	start = std::clock();
+	for (int r = 0; r < runs; r++) a.multiply(x.data(), y.data());
+	std::cout << "\t" << 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / runs;
+	start = std::clock();
+	for (int r = 0; r < runs; r++) a.multiplyTransposed(x.data(), y.data());
+	std::cout << "\t" << 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC / runs << std::endl;
+}
+
+void benchmarkFactorization()
+{
+	std::cout << "size\tlu(GFlop/s)\tcholesky(GFlop/s)\tqr(GFlop/s)" << std::endl;
+	for (size_t n = 256; n <= 2048; n *= 2)
+	{
+		Matrix a, t, spd;
+		randomMatrix(n, n, a);
+		a.transpose(t);
+		a.multiply(t, spd);
+		for (size_t i = 0; i < n; i++) spd(i, i) += n;
+		double cube = (double) n * n * n;
+
+		std::clock_t start = std::clock();
+		LU lu(a);
+		double luRate = 2.0 / 3.0 * cube / ((double) (std::clock() - start) / CLOCKS_PER_SEC) / 1e9;
+
+		start = std::clock();
+		Cholesky cholesky(spd);
+		double choleskyRate = 1.0 / 3.0 * cube / ((double) (std::clock() - start) / CLOCKS_PER_SEC) / 1e9;
+
+		start = std::clock();
+		QR qr(a);
+		double qrRate = 4.0 / 3.0 * cube / ((double) (std::clock() - start) / CLOCKS_PER_SEC) / 1e9;
+
+		std::cout << n << "\t" << luRate << "\t" << choleskyRate << "\t" << qrRate << std::endl;
+	}
+}
+
+void benchmarkDivision()
+{
+	std::cout << "divisor\tlong(ms)\tnewton(ms)" << std::endl;
+	for (size_t n = 1 << 8; n <= (1 << 14); n *= 4)
+	{
+		Polynomial a(2 * n), b(n), q, r;
+		for (size_t i = 0; i < a.size(); i++) a[i] = (std::rand() % 200 - 100) / 100.0;
+		for (size_t i = 0; i < n; i++) b[i] = (std::rand() % 200 - 100) / (100.0 * n);
+		b[n - 1] = 2.0;
+
+		// with every size below the cutoff divmod falls back to long division
+		MultiplyConfig saved = MultiplyConfig::current();
+		MultiplyConfig::current().divisionThreshold = (size_t) -1;
+		std::clock_t start = std::clock();
+		a.divmod(b, q, r);
+		double slow = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+		MultiplyConfig::current() = saved;
+
+		start = std::clock();
+		a.divmod(b, q, r);
+		double fast = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+
+		std::cout << n << "\t" << slow << "\t" << fast << std::endl;
+	}
+}
+
 int main(int argc, char** argv)
 {
 	testPolynomialCalculate();
 
+	testEvaluation();
+
+	testDivision();
+
+	testInterpolation();
+
+	testSpectral();
+
+	testConvolver();
+
+	testMatrix();
+
+	testFactorization();
+
+	testSparse();
+
+	testTransform();
+
+	testBatch();
+
+	testSixStep();
+
+	testParallel();
+
+	testMultiplicationSizes();
+
+	testIntegerMultiplication();
+
+	testExpressions();
+
+	testStorage();
+
 	testMultiplication();
 
+	MultiplyConfig::current() = calibrateMultiply();
+	saveMultiplyConfig(MultiplyConfig::current(), std::cout);
+
+	benchmarkMultiplication();
+
+	benchmarkEvaluation();
+
+	benchmarkDivision();
+
+	benchmarkSpectral();
+
+	benchmarkConvolver();
+
+	benchmarkMatrix();
+
+	benchmarkStrassen();
+
+	benchmarkFactorization();
+
+	benchmarkSparse();
+
 	char _c;
 	std::cin >> _c;
 	return 0;
@@ -0,0 +1,445 @@
+#include "matrix.h"
+#include "cpu.h"
+#include <threadpool.h>
+#include <cassert>
+
+namespace
+{
+	// Register tile of the micro-kernel and cache blocks, BLIS style: a KC x NR sliver of B stays in L1,
+	// an MC x KC block of A in L2 and a KC x NC panel of B in L3.
+	const size_t MR = 6;
+	const size_t NR = 8;
+	const size_t KC = 256;
+	const size_t MC = 72;
+	const size_t NC = 3072;
+
+	typedef std::vector<double, AlignedAllocator<double, Matrix::Alignment> > Buffer;
+
+	// A block into MR row slivers, sliver s holds a[s*MR + i][p] at p * MR + i, short slivers padded with zeros
+	void packA(size_t mc, size_t kc, const double* a, size_t lda, double* out)
+	{
+		for (size_t s = 0; s < mc; s += MR)
+		{
+			size_t rows = std::min(MR, mc - s);
+			for (size_t p = 0; p < kc; p++)
+			{
+				for (size_t i = 0; i < rows; i++)
+				{
+					out[p * MR + i] = a[(s + i) * lda + p];
+				}
+				for (size_t i = rows; i < MR; i++)
+				{
+					out[p * MR + i] = 0.0;
+				}
+			}
+			out += kc * MR;
+		}
+	}
+
+	// B panel into NR column slivers, sliver s holds b[p][s*NR + j] at p * NR + j
+	void packB(size_t kc, size_t nc, const double* b, size_t ldb, double* out)
+	{
+		for (size_t s = 0; s < nc; s += NR)
+		{
+			size_t cols = std::min(NR, nc - s);
+			for (size_t p = 0; p < kc; p++)
+			{
+				const double* src = b + p * ldb + s;
+				for (size_t j = 0; j < cols; j++)
+				{
+					out[p * NR + j] = src[j];
+				}
+				for (size_t j = cols; j < NR; j++)
+				{
+					out[p * NR + j] = 0.0;
+				}
+			}
+			out += kc * NR;
+		}
+	}
+
+	// c[MR x NR] += alpha * a sliver * b sliver
+	void kernelScalar(size_t kc, double alpha, const double* a, const double* b, double* c, size_t ldc)
+	{
+		double acc[MR][NR] = {};
+		for (size_t p = 0; p < kc; p++)
+		{
+			for (size_t i = 0; i < MR; i++)
+			{
+				double ai = a[p * MR + i];
+				for (size_t j = 0; j < NR; j++)
+				{
+					acc[i][j] += ai * b[p * NR + j];
+				}
+			}
+		}
+		for (size_t i = 0; i < MR; i++)
+		{
+			for (size_t j = 0; j < NR; j++)
+			{
+				c[i * ldc + j] += alpha * acc[i][j];
+			}
+		}
+	}
+
+#ifdef CPU_X86
+	// 6 x 8 tile in 12 ymm accumulators, every step is one broadcast of a per row and two loads of b
+	CPU_TARGET_AVX2
+	void kernelAvx2(size_t kc, double alpha, const double* a, const double* b, double* c, size_t ldc)
+	{
+		__m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+		__m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+		__m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+		__m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+		__m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+		__m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+		for (size_t p = 0; p < kc; p++)
+		{
+			__m256d b0 = _mm256_load_pd(b);
+			__m256d b1 = _mm256_load_pd(b + 4);
+			__m256d ai;
+			ai = _mm256_broadcast_sd(a + 0); c00 = _mm256_fmadd_pd(ai, b0, c00); c01 = _mm256_fmadd_pd(ai, b1, c01);
+			ai = _mm256_broadcast_sd(a + 1); c10 = _mm256_fmadd_pd(ai, b0, c10); c11 = _mm256_fmadd_pd(ai, b1, c11);
+			ai = _mm256_broadcast_sd(a + 2); c20 = _mm256_fmadd_pd(ai, b0, c20); c21 = _mm256_fmadd_pd(ai, b1, c21);
+			ai = _mm256_broadcast_sd(a + 3); c30 = _mm256_fmadd_pd(ai, b0, c30); c31 = _mm256_fmadd_pd(ai, b1, c31);
+			ai = _mm256_broadcast_sd(a + 4); c40 = _mm256_fmadd_pd(ai, b0, c40); c41 = _mm256_fmadd_pd(ai, b1, c41);
+			ai = _mm256_broadcast_sd(a + 5); c50 = _mm256_fmadd_pd(ai, b0, c50); c51 = _mm256_fmadd_pd(ai, b1, c51);
+			a += MR;
+			b += NR;
+		}
+
+		__m256d s = _mm256_set1_pd(alpha);
+		double* r;
+		r = c;           _mm256_storeu_pd(r, _mm256_fmadd_pd(s, c00, _mm256_loadu_pd(r))); _mm256_storeu_pd(r + 4, _mm256_fmadd_pd(s, c01, _mm256_loadu_pd(r + 4)));
+		r = c + ldc;     _mm256_storeu_pd(r, _mm256_fmadd_pd(s, c10, _mm256_loadu_pd(r))); _mm256_storeu_pd(r + 4, _mm256_fmadd_pd(s, c11, _mm256_loadu_pd(r + 4)));
+		r = c + 2 * ldc; _mm256_storeu_pd(r, _mm256_fmadd_pd(s, c20, _mm256_loadu_pd(r))); _mm256_storeu_pd(r + 4, _mm256_fmadd_pd(s, c21, _mm256_loadu_pd(r + 4)));
+		r = c + 3 * ldc; _mm256_storeu_pd(r, _mm256_fmadd_pd(s, c30, _mm256_loadu_pd(r))); _mm256_storeu_pd(r + 4, _mm256_fmadd_pd(s, c31, _mm256_loadu_pd(r + 4)));
+		r = c + 4 * ldc; _mm256_storeu_pd(r, _mm256_fmadd_pd(s, c40, _mm256_loadu_pd(r))); _mm256_storeu_pd(r + 4, _mm256_fmadd_pd(s, c41, _mm256_loadu_pd(r + 4)));
+		r = c + 5 * ldc; _mm256_storeu_pd(r, _mm256_fmadd_pd(s, c50, _mm256_loadu_pd(r))); _mm256_storeu_pd(r + 4, _mm256_fmadd_pd(s, c51, _mm256_loadu_pd(r + 4)));
+	}
+#endif
+
+	typedef void (*Kernel)(size_t kc, double alpha, const double* a, const double* b, double* c, size_t ldc);
+
+	Kernel selectKernel()
+	{
+#ifdef CPU_X86
+		if (cpu::current() != cpu::Scalar)
+		{
+			return kernelAvx2;
+		}
+#endif
+		return kernelScalar;
+	}
+
+	// C block (mc x nc) += alpha * packed A block * packed B panel
+	void macroKernel(Kernel kernel, size_t mc, size_t nc, size_t kc, double alpha, const double* packedA, const double* packedB, double* c, size_t ldc)
+	{
+		double edge[MR * NR];
+		for (size_t jr = 0; jr < nc; jr += NR)
+		{
+			size_t cols = std::min(NR, nc - jr);
+			for (size_t ir = 0; ir < mc; ir += MR)
+			{
+				size_t rows = std::min(MR, mc - ir);
+				const double* a = packedA + ir * kc;
+				const double* b = packedB + jr * kc;
+				double* tile = c + ir * ldc + jr;
+				if (rows == MR && cols == NR)
+				{
+					kernel(kc, alpha, a, b, tile, ldc);
+					continue;
+				}
+
+				// partial tile: run the full kernel on a scratch tile and add the valid part
+				std::fill(edge, edge + MR * NR, 0.0);
+				kernel(kc, alpha, a, b, edge, NR);
+				for (size_t i = 0; i < rows; i++)
+				{
+					for (size_t j = 0; j < cols; j++)
+					{
+						tile[i * ldc + j] += edge[i * NR + j];
+					}
+				}
+			}
+		}
+	}
+}
+
+void gemm(size_t m, size_t n, size_t k, double alpha, const double* a, size_t lda, const double* b, size_t ldb, double beta, double* c, size_t ldc)
+{
+	if (beta != 1.0)
+	{
+		for (size_t i = 0; i < m; i++)
+		{
+			double* ci = c + i * ldc;
+			for (size_t j = 0; j < n; j++)
+			{
+				ci[j] = (beta == 0.0) ? 0.0 : beta * ci[j];
+			}
+		}
+	}
+	if (m == 0 || n == 0 || k == 0 || alpha == 0.0)
+	{
+		return;
+	}
+
+	Kernel kernel = selectKernel();
+	ThreadPool& pool = ThreadPool::shared();
+	bool parallel = pool.size() > 1 && (double) m * n * k >= 1e6;
+
+	Buffer packedB(KC * std::min(NC, (n + NR - 1) / NR * NR));
+	for (size_t jc = 0; jc < n; jc += NC)
+	{
+		size_t nc = std::min(NC, n - jc);
+		for (size_t pc = 0; pc < k; pc += KC)
+		{
+			size_t kc = std::min(KC, k - pc);
+			packB(kc, nc, b + pc * ldb + jc, ldb, packedB.data());
+
+			// row blocks of C are independent, every chunk packs its own A blocks
+			size_t blocks = (m + MC - 1) / MC;
+			auto rowBlocks = [&](size_t first, size_t last)
+			{
+				Buffer packedA(MC * kc);
+				for (size_t blk = first; blk < last; blk++)
+				{
+					size_t ic = blk * MC;
+					size_t mc = std::min(MC, m - ic);
+					packA(mc, kc, a + ic * lda + pc, lda, packedA.data());
+					macroKernel(kernel, mc, nc, kc, alpha, packedA.data(), packedB.data(), c + ic * ldc + jc, ldc);
+				}
+			};
+			if (parallel && blocks > 1)
+			{
+				pool.parallelFor(0, blocks, 1, rowBlocks);
+			}
+			else
+			{
+				rowBlocks(0, blocks);
+			}
+		}
+	}
+}
+
+namespace
+{
+	// Stack of temporaries for the strassen levels, a level takes its blocks on the way down and
+	// gives them back before returning.
+	class Arena
+	{
+	public:
+		Arena(size_t count) : buffer(count), used(0) {}
+
+		size_t mark() const { return used; }
+		void release(size_t position) { used = position; }
+
+		double* take(size_t count)
+		{
+			// every block starts on a cache line
+			size_t start = used;
+			used += (count + 7) / 8 * 8;
+			assert(used <= buffer.size());
+			return buffer.data() + start;
+		}
+
+	private:
+		Buffer buffer;
+		size_t used;
+	};
+
+	size_t padded(size_t columns)
+	{
+		return (columns + 7) / 8 * 8;
+	}
+
+	// out = x + sign y on an m x n block
+	void addBlocks(size_t m, size_t n, const double* x, size_t ldx, double sign, const double* y, size_t ldy, double* out, size_t ldo)
+	{
+		for (size_t i = 0; i < m; i++)
+		{
+			const double* xi = x + i * ldx;
+			const double* yi = y + i * ldy;
+			double* oi = out + i * ldo;
+			for (size_t j = 0; j < n; j++)
+			{
+				oi[j] = xi[j] + sign * yi[j];
+			}
+		}
+	}
+
+	void strassenLevel(Arena& arena, size_t m, size_t n, size_t k, const double* a, size_t lda, const double* b, size_t ldb, double* c, size_t ldc, size_t cutoff)
+	{
+		if (std::min(std::min(m, n), k) <= cutoff)
+		{
+			gemm(m, n, k, 1.0, a, lda, b, ldb, 0.0, c, ldc);
+			return;
+		}
+
+		// the even part recursively, then the odd row, column and inner index
+		size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+		const double *a11 = a, *a12 = a + k2, *a21 = a + m2 * lda, *a22 = a21 + k2;
+		const double *b11 = b, *b12 = b + n2, *b21 = b + k2 * ldb, *b22 = b21 + n2;
+		double *c11 = c, *c12 = c + n2, *c21 = c + m2 * ldc, *c22 = c21 + n2;
+
+		size_t position = arena.mark();
+		size_t lds = padded(k2), ldt = padded(n2), ldp = padded(n2);
+		double* s = arena.take(m2 * lds);
+		double* t = arena.take(k2 * ldt);
+		double* p = arena.take(m2 * ldp);
+
+		// C21 = P7 = (A11 - A21)(B22 - B12)
+		addBlocks(m2, k2, a11, lda, -1.0, a21, lda, s, lds);
+		addBlocks(k2, n2, b22, ldb, -1.0, b12, ldb, t, ldt);
+		strassenLevel(arena, m2, n2, k2, s, lds, t, ldt, c21, ldc, cutoff);
+		// C22 = P5 = S1 T1 with S1 = A21 + A22 and T1 = B12 - B11
+		addBlocks(m2, k2, a21, lda, 1.0, a22, lda, s, lds);
+		addBlocks(k2, n2, b12, ldb, -1.0, b11, ldb, t, ldt);
+		strassenLevel(arena, m2, n2, k2, s, lds, t, ldt, c22, ldc, cutoff);
+		// C12 = P6 = S2 T2 with S2 = S1 - A11 and T2 = B22 - T1
+		addBlocks(m2, k2, s, lds, -1.0, a11, lda, s, lds);
+		addBlocks(k2, n2, b22, ldb, -1.0, t, ldt, t, ldt);
+		strassenLevel(arena, m2, n2, k2, s, lds, t, ldt, c12, ldc, cutoff);
+
+		// P = P1 = A11 B11, then U2 = P1 + P6, U3 = U2 + P7, U4 = U2 + P5 and C22 = U3 + P5 in place
+		strassenLevel(arena, m2, n2, k2, a11, lda, b11, ldb, p, ldp, cutoff);
+		addBlocks(m2, n2, c12, ldc, 1.0, p, ldp, c12, ldc);
+		addBlocks(m2, n2, c21, ldc, 1.0, c12, ldc, c21, ldc);
+		addBlocks(m2, n2, c12, ldc, 1.0, c22, ldc, c12, ldc);
+		addBlocks(m2, n2, c22, ldc, 1.0, c21, ldc, c22, ldc);
+
+		// C11 = P2 + P1 with P2 = A12 B21
+		strassenLevel(arena, m2, n2, k2, a12, lda, b21, ldb, c11, ldc, cutoff);
+		addBlocks(m2, n2, c11, ldc, 1.0, p, ldp, c11, ldc);
+		// C12 = U4 + P3 with P3 = (A12 - S2) B22
+		addBlocks(m2, k2, a12, lda, -1.0, s, lds, s, lds);
+		strassenLevel(arena, m2, n2, k2, s, lds, b22, ldb, p, ldp, cutoff);
+		addBlocks(m2, n2, c12, ldc, 1.0, p, ldp, c12, ldc);
+		// C21 = U3 - P4 with P4 = A22 (T2 - B21)
+		addBlocks(k2, n2, t, ldt, -1.0, b21, ldb, t, ldt);
+		strassenLevel(arena, m2, n2, k2, a22, lda, t, ldt, p, ldp, cutoff);
+		addBlocks(m2, n2, c21, ldc, -1.0, p, ldp, c21, ldc);
+		arena.release(position);
+
+		size_t me = 2 * m2, ne = 2 * n2, ke = 2 * k2;
+		if (ke < k)
+		{
+			gemm(me, ne, 1, 1.0, a + ke, lda, b + ke * ldb, ldb, 1.0, c, ldc);
+		}
+		if (ne < n)
+		{
+			gemm(me, 1, k, 1.0, a, lda, b + ne, ldb, 0.0, c + ne, ldc);
+		}
+		if (me < m)
+		{
+			gemm(1, n, k, 1.0, a + me * lda, lda, b, ldb, 0.0, c + me * ldc, ldc);
+		}
+	}
+}
+
+void strassen(size_t m, size_t n, size_t k, const double* a, size_t lda, const double* b, size_t ldb, double* c, size_t ldc, size_t cutoff)
+{
+	if (cutoff == 0)
+	{
+		cutoff = StrassenCutoff;
+	}
+
+	// three blocks per level, each level a quarter of the one above
+	size_t total = 0;
+	for (size_t mm = m, nn = n, kk = k; std::min(std::min(mm, nn), kk) > cutoff; mm /= 2, nn /= 2, kk /= 2)
+	{
+		total += (mm / 2) * padded(kk / 2) + (kk / 2) * padded(nn / 2) + (mm / 2) * padded(nn / 2);
+	}
+	Arena arena(total);
+	strassenLevel(arena, m, n, k, a, lda, b, ldb, c, ldc, cutoff);
+}
+
+void Matrix::transpose(Matrix& outResult) const
+{
+	assert(&outResult != this);
+	const size_t Tile = 32;
+
+	outResult.resize(m, n);
+	for (size_t i0 = 0; i0 < n; i0 += Tile)
+	{
+		size_t i1 = std::min(n, i0 + Tile);
+		for (size_t j0 = 0; j0 < m; j0 += Tile)
+		{
+			size_t j1 = std::min(m, j0 + Tile);
+			for (size_t i = i0; i < i1; i++)
+			{
+				const double* src = row(i);
+				for (size_t j = j0; j < j1; j++)
+				{
+					outResult(j, i) = src[j];
+				}
+			}
+		}
+	}
+}
+
+void Matrix::multiply(const Matrix& other, Matrix& outResult) const
+{
+	assert(m == other.n && &outResult != this && &outResult != &other);
+	outResult.resize(n, other.m);
+	gemm(n, other.m, m, 1.0, data(), ld, other.data(), other.ld, 0.0, outResult.data(), outResult.ld);
+}
+
+void Matrix::multiplyStrassen(const Matrix& other, Matrix& outResult, size_t cutoff) const
+{
+	assert(m == other.n && &outResult != this && &outResult != &other);
+	outResult.resize(n, other.m);
+	strassen(n, other.m, m, data(), ld, other.data(), other.ld, outResult.data(), outResult.ld, cutoff);
+}
+
+void Matrix::multiply(const double* x, double* outY) const
+{
+	// one dot product per row, four partial sums so the additions do not wait on each other
+	auto rowsDot = [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			const double* r = row(i);
+			double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+			size_t j = 0;
+			for (; j + 4 <= m; j += 4)
+			{
+				s0 += r[j] * x[j];
+				s1 += r[j + 1] * x[j + 1];
+				s2 += r[j + 2] * x[j + 2];
+				s3 += r[j + 3] * x[j + 3];
+			}
+			for (; j < m; j++)
+			{
+				s0 += r[j] * x[j];
+			}
+			outY[i] = (s0 + s1) + (s2 + s3);
+		}
+	};
+
+	ThreadPool& pool = ThreadPool::shared();
+	if (pool.size() > 1 && n * m >= (1 << 18))
+	{
+		pool.parallelFor(0, n, std::max<size_t>(1, (1 << 16) / std::max<size_t>(m, 1)), rowsDot);
+	}
+	else
+	{
+		rowsDot(0, n);
+	}
+}
+
+void Matrix::multiplyTransposed(const double* x, double* outY) const
+{
+	// y += x[i] * row i, streams the rows in memory order
+	std::fill(outY, outY + m, 0.0);
+	for (size_t i = 0; i < n; i++)
+	{
+		const double* r = row(i);
+		double xi = x[i];
+		for (size_t j = 0; j < m; j++)
+		{
+			outY[j] += xi * r[j];
+		}
+	}
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "polynomial.h"
+#include <vector>
+
+namespace multipoint
+{
+	// Products of (x - x_i) over a balanced split of the points: the root is the product over all of them,
+	// leaves hold up to LeafSize points. Building costs O(M(n) log n) with M the multiply cost.
+	template<typename T, typename Allocator = std::allocator<T> >
+	class SubproductTree
+	{
+	public:
+		typedef TPolynomial<T, Allocator> Poly;
+		typedef TPolynomialModulus<T, Allocator> Modulus;
+		static const size_t LeafSize = 32;
+
+		SubproductTree(const T* points, size_t count);
+
+		size_t      size() const    { return xs.size(); }
+		const T*    points() const  { return xs.data(); }
+		const Poly& root() const    { return nodes[1].divisor(); }
+
+		// Values of p at all the points, p of any size. O(M(n) log n) by reducing p down the tree.
+		void evaluate(const Poly& p, T* outValues) const;
+		// The polynomial with size() coefficients taking values[i] at point i, the points must be distinct.
+		// Lagrange form sum values[i] / M'(x_i) * M(x) / (x - x_i) with M the root, summed up the tree in O(M(n) log n).
+		void interpolate(const T* values, Poly& outResult) const;
+
+	private:
+		void build(size_t node, size_t begin, size_t end);
+		void evaluate(const Poly& p, size_t node, size_t begin, size_t end, T* outValues) const;
+		void combine(const T* weights, size_t node, size_t begin, size_t end, Poly& outResult) const;
+
+		std::vector<T> xs;
+		// children of node i are 2i and 2i + 1, node 0 is unused. A node reduces the remainder of its parent,
+		// which is below twice its size, so the inverse cached by the modulus always suffices.
+		std::vector<Modulus> nodes;
+	};
+
+	// p at count points, through a SubproductTree.
+	template<typename T, typename Allocator>
+	void evaluate(const TPolynomial<T, Allocator>& p, const T* points, size_t count, T* outValues)
+	{
+		SubproductTree<T, Allocator> tree(points, count);
+		tree.evaluate(p, outValues);
+	}
+
+	// Inverse of evaluate: the polynomial with count coefficients through (points[i], values[i]).
+	template<typename T, typename Allocator>
+	void interpolate(const T* points, const T* values, size_t count, TPolynomial<T, Allocator>& outResult)
+	{
+		SubproductTree<T, Allocator> tree(points, count);
+		tree.interpolate(values, outResult);
+	}
+
+	// ---- Inline implementation ----
+
+	template<typename T, typename Allocator>
+	inline SubproductTree<T, Allocator>::SubproductTree(const T* points, size_t count)
+		: xs(points, points + count)
+	{
+		// ranges split at the middle with the larger half on the right, so the last node is on the rightmost path
+		size_t last = 1;
+		for (size_t n = count; n > LeafSize; n -= n / 2)
+		{
+			last = 2 * last + 1;
+		}
+		nodes.resize(last + 1);
+		if (count == 0)
+		{
+			Poly one(1);
+			one[0] = T(1);
+			nodes[1] = Modulus(one);
+			return;
+		}
+		build(1, 0, count);
+	}
+
+	template<typename T, typename Allocator>
+	inline void SubproductTree<T, Allocator>::build(size_t node, size_t begin, size_t end)
+	{
+		Poly product;
+		if (end - begin <= LeafSize)
+		{
+			// (x - x_begin) ... (x - x_end-1), one linear factor at a time
+			product.resize(1);
+			product[0] = T(1);
+			for (size_t i = begin; i < end; i++)
+			{
+				size_t d = product.size();
+				product.resize(d + 1);
+				for (size_t j = d; j > 0; j--)
+				{
+					product[j] = product[j - 1] - xs[i] * product[j];
+				}
+				product[0] = T() - xs[i] * product[0];
+			}
+		}
+		else
+		{
+			size_t mid = begin + (end - begin) / 2;
+			build(2 * node, begin, mid);
+			build(2 * node + 1, mid, end);
+			nodes[2 * node].divisor().multiply(nodes[2 * node + 1].divisor(), product);
+		}
+		nodes[node] = Modulus(product);
+	}
+
+	template<typename T, typename Allocator>
+	inline void SubproductTree<T, Allocator>::evaluate(const Poly& p, T* outValues) const
+	{
+		if (xs.empty())
+		{
+			return;
+		}
+
+		Poly reduced;
+		nodes[1].reduce(p, reduced);
+		evaluate(reduced, 1, 0, xs.size(), outValues);
+	}
+
+	template<typename T, typename Allocator>
+	inline void SubproductTree<T, Allocator>::evaluate(const Poly& p, size_t node, size_t begin, size_t end, T* outValues) const
+	{
+		// p is already reduced modulo this node
+		if (end - begin <= LeafSize)
+		{
+			p.calculate(xs.data() + begin, end - begin, outValues + begin);
+			return;
+		}
+
+		size_t mid = begin + (end - begin) / 2;
+		Poly r;
+		nodes[2 * node].reduce(p, r);
+		evaluate(r, 2 * node, begin, mid, outValues);
+		nodes[2 * node + 1].reduce(p, r);
+		evaluate(r, 2 * node + 1, mid, end, outValues);
+	}
+
+	template<typename T, typename Allocator>
+	inline void SubproductTree<T, Allocator>::interpolate(const T* values, Poly& outResult) const
+	{
+		size_t n = xs.size();
+		if (n == 0)
+		{
+			outResult.resize(0);
+			return;
+		}
+
+		// M'(x_i) = prod over j != i of (x_i - x_j)
+		Poly derivative;
+		root().derivative(derivative);
+		std::vector<T> weights(n);
+		evaluate(derivative, weights.data());
+		for (size_t i = 0; i < n; i++)
+		{
+			weights[i] = values[i] * multiplicativeInverse(weights[i]);
+		}
+		combine(weights.data(), 1, 0, n, outResult);
+	}
+
+	template<typename T, typename Allocator>
+	inline void SubproductTree<T, Allocator>::combine(const T* weights, size_t node, size_t begin, size_t end, Poly& outResult) const
+	{
+		// outResult = sum over the node's points of weights[i] * product / (x - x_i)
+		if (end - begin <= LeafSize)
+		{
+			const Poly& product = nodes[node].divisor();
+			size_t m = end - begin;
+			outResult.resize(0);
+			outResult.resize(m);
+			Poly q(m);
+			for (size_t i = begin; i < end; i++)
+			{
+				// synthetic division by (x - x_i), exact since x_i is a root
+				q[m - 1] = product[m];
+				for (size_t j = m - 1; j > 0; j--)
+				{
+					q[j - 1] = product[j] + xs[i] * q[j];
+				}
+				for (size_t j = 0; j < m; j++)
+				{
+					outResult[j] += weights[i] * q[j];
+				}
+			}
+			return;
+		}
+
+		// left * M_right + right * M_left
+		size_t mid = begin + (end - begin) / 2;
+		Poly left, right, a, b;
+		combine(weights, 2 * node, begin, mid, left);
+		combine(weights, 2 * node + 1, mid, end, right);
+		left.multiply(nodes[2 * node + 1].divisor(), a);
+		right.multiply(nodes[2 * node].divisor(), b);
+		a.add(b, outResult);
+	}
+}
@@ -0,0 +1,344 @@
+#include "ntt.h"
+#include <cassert>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace ntt
+{
+	inline uint32_t mulMod(uint32_t a, uint32_t b, uint32_t modulus)
+	{
+		return (uint32_t) ((uint64_t) a * b % modulus);
+	}
+
+	inline uint32_t powMod(uint32_t base, uint64_t exponent, uint32_t modulus)
+	{
+		uint32_t r = 1;
+		while (exponent > 0)
+		{
+			if (exponent & 1)
+			{
+				r = mulMod(r, base, modulus);
+			}
+			base = mulMod(base, base, modulus);
+			exponent >>= 1;
+		}
+		return r;
+	}
+
+	// Shoup's multiplication by a constant w, with wShoup = floor(w * 2^32 / modulus): the quotient estimate is
+	// off by at most one, so one conditional subtraction replaces the division of mulMod.
+	inline uint32_t shoup(uint32_t w, uint32_t modulus)
+	{
+		return (uint32_t) (((uint64_t) w << 32) / modulus);
+	}
+
+	inline uint32_t mulShoup(uint32_t x, uint32_t w, uint32_t wShoup, uint32_t modulus)
+	{
+		uint32_t q = (uint32_t) (((uint64_t) x * wShoup) >> 32);
+		uint32_t r = x * w - q * modulus;
+		return (r >= modulus) ? r - modulus : r;
+	}
+
+	inline size_t powerOfTwo(size_t n)
+	{
+		size_t n2 = 1;
+		while (n2 < n)
+		{
+			n2 <<= 1;
+		}
+		return n2;
+	}
+
+	template<uint32_t Modulus>
+	Plan<Modulus>::Plan(size_t size, bool inverse) : n(size), inv(inverse), permutation(size), roots(size), rootsShoup(size)
+	{
+		const uint32_t PrimitiveRoot = 3;
+		assert((n & (n - 1)) == 0 && (Modulus - 1) % n == 0);
+
+		uint32_t w = powMod(PrimitiveRoot, (Modulus - 1) / n, Modulus);
+		if (inverse)
+		{
+			w = powMod(w, Modulus - 2, Modulus);
+		}
+		std::vector<uint32_t> powers(n / 2);
+		uint32_t wk = 1;
+		for (size_t k = 0; k < powers.size(); k++)
+		{
+			powers[k] = wk;
+			wk = mulMod(wk, w, Modulus);
+		}
+		// the roots of the stage with half length m at m .. 2m - 1, so every stage reads them in order
+		for (size_t m = 1; m < n; m <<= 1)
+		{
+			for (size_t j = 0; j < m; j++)
+			{
+				roots[m + j] = powers[j * (n / (2 * m))];
+				rootsShoup[m + j] = shoup(roots[m + j], Modulus);
+			}
+		}
+		scale = (inverse) ? powMod((uint32_t) (n % Modulus), Modulus - 2, Modulus) : 1;
+		scaleShoup = shoup(scale, Modulus);
+
+		size_t log2n = 0;
+		while (((size_t) 1 << log2n) < n)
+		{
+			log2n++;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			size_t r = 0;
+			for (size_t b = 0; b < log2n; b++)
+			{
+				r |= ((i >> b) & 1) << (log2n - 1 - b);
+			}
+			permutation[i] = r;
+		}
+	}
+
+	template<uint32_t Modulus>
+	void Plan<Modulus>::execute(uint32_t* data) const
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			size_t j = permutation[i];
+			if (i < j)
+			{
+				std::swap(data[i], data[j]);
+			}
+		}
+
+		for (size_t m = 1; m < n; m <<= 1)
+		{
+			const uint32_t* w = roots.data() + m;
+			const uint32_t* wShoup = rootsShoup.data() + m;
+			for (size_t i = 0; i < n; i += 2 * m)
+			{
+				uint32_t* x = data + i;
+				uint32_t* y = data + i + m;
+				for (size_t j = 0; j < m; j++)
+				{
+					uint32_t u = x[j];
+					uint32_t v = mulShoup(y[j], w[j], wShoup[j], Modulus);
+					x[j] = (u + v >= Modulus) ? u + v - Modulus : u + v;
+					y[j] = (u >= v) ? u - v : u + Modulus - v;
+				}
+			}
+		}
+
+		if (inv)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				data[i] = mulShoup(data[i], scale, scaleShoup, Modulus);
+			}
+		}
+	}
+
+	template<uint32_t Modulus>
+	const Plan<Modulus>& Plan<Modulus>::get(size_t size, bool inverse)
+	{
+		static std::mutex cacheMutex;
+		static std::map<std::pair<size_t, bool>, std::unique_ptr<Plan>> cache;
+
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		std::unique_ptr<Plan>& plan = cache[std::make_pair(size, inverse)];
+		if (!plan)
+		{
+			plan.reset(new Plan(size, inverse));
+		}
+		return *plan;
+	}
+
+	template class Plan<Prime1>;
+	template class Plan<Prime2>;
+
+	// Residues modulo Prime1 go up to 2^23 points, Prime2 allows more.
+	const size_t MaxSize = (size_t) 1 << 23;
+	const size_t Limbs = 4;
+
+	template<uint32_t Modulus>
+	void toResidues(const PolynomialInteger& p, uint32_t* outResidues, size_t n)
+	{
+		for (size_t i = 0; i < p.size(); i++)
+		{
+			outResidues[i] = (uint32_t) (p[i] % Modulus);
+		}
+		std::fill(outResidues + p.size(), outResidues + n, 0);
+	}
+
+	// Cyclic convolution of size n modulo Modulus, outResidues gets the first resultSize values.
+	// a and b are scratch buffers of n values.
+	template<uint32_t Modulus>
+	void convolve(const PolynomialInteger& p1, const PolynomialInteger& p2, size_t n, std::vector<uint32_t>& a, std::vector<uint32_t>& b, std::vector<uint32_t>& outResidues)
+	{
+		const Plan<Modulus>& direct = Plan<Modulus>::get(n, false);
+		const Plan<Modulus>& inverse = Plan<Modulus>::get(n, true);
+
+		toResidues<Modulus>(p1, a.data(), n);
+		toResidues<Modulus>(p2, b.data(), n);
+		direct.execute(a.data());
+		direct.execute(b.data());
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = mulMod(a[i], b[i], Modulus);
+		}
+		inverse.execute(a.data());
+
+		outResidues.assign(a.begin(), a.begin() + outResidues.size());
+	}
+
+	// Limb j of the coefficients of p, bits 16 j to 16 j + 15, at outLimbs[j * n], zero padded to n.
+	void toLimbs(const PolynomialInteger& p, uint32_t* outLimbs, size_t n)
+	{
+		for (size_t j = 0; j < Limbs; j++)
+		{
+			uint32_t* limb = outLimbs + j * n;
+			for (size_t i = 0; i < p.size(); i++)
+			{
+				limb[i] = (uint32_t) (p[i] >> (16 * j)) & 0xffff;
+			}
+			std::fill(limb + p.size(), limb + n, 0);
+		}
+	}
+
+	// outSums[s] gets the first resultSize values modulo Modulus of the sum of the products of limb j of p1
+	// and limb k of p2 over j + k = s. The higher sums only reach past bit 64.
+	// a and b are scratch buffers of Limbs * n values.
+	template<uint32_t Modulus>
+	void convolveLimbs(const PolynomialInteger& p1, const PolynomialInteger& p2, size_t n, std::vector<uint32_t>& a, std::vector<uint32_t>& b, std::vector<uint32_t>* outSums)
+	{
+		const Plan<Modulus>& direct = Plan<Modulus>::get(n, false);
+		const Plan<Modulus>& inverse = Plan<Modulus>::get(n, true);
+
+		// limbs are below 2^16 and so already reduced
+		toLimbs(p1, a.data(), n);
+		toLimbs(p2, b.data(), n);
+		for (size_t j = 0; j < Limbs; j++)
+		{
+			direct.execute(a.data() + j * n);
+			direct.execute(b.data() + j * n);
+		}
+
+		std::vector<uint32_t> sum(n);
+		for (size_t s = 0; s < Limbs; s++)
+		{
+			std::fill(sum.begin(), sum.end(), 0);
+			for (size_t j = 0; j <= s; j++)
+			{
+				const uint32_t* x = a.data() + j * n;
+				const uint32_t* y = b.data() + (s - j) * n;
+				for (size_t i = 0; i < n; i++)
+				{
+					uint32_t v = sum[i] + mulMod(x[i], y[i], Modulus);
+					sum[i] = (v >= Modulus) ? v - Modulus : v;
+				}
+			}
+			inverse.execute(sum.data());
+			outSums[s].assign(sum.begin(), sum.begin() + outSums[s].size());
+		}
+	}
+
+	typedef void (*Product)(const PolynomialInteger&, const PolynomialInteger&, PolynomialInteger&);
+
+	// Products longer than a transform: the operands in blocks of MaxSize / 2 coefficients and the products of
+	// all pairs of blocks added at their offsets, modulo 2^64 or, when modulus is not 0, modulo that.
+	void multiplyBlocks(const PolynomialInteger& p1, const PolynomialInteger& p2, Product product, uint64_t modulus, PolynomialInteger& outResult)
+	{
+		const size_t block = MaxSize / 2;
+		outResult.resize(p1.size() + p2.size() - 1);
+		std::fill(outResult.data(), outResult.data() + outResult.size(), 0);
+
+		PolynomialInteger a, b, ab;
+		for (size_t i = 0; i < p1.size(); i += block)
+		{
+			a.resize(std::min(block, p1.size() - i));
+			std::copy(p1.data() + i, p1.data() + i + a.size(), a.data());
+			for (size_t j = 0; j < p2.size(); j += block)
+			{
+				b.resize(std::min(block, p2.size() - j));
+				std::copy(p2.data() + j, p2.data() + j + b.size(), b.data());
+				product(a, b, ab);
+				uint64_t* out = outResult.data() + i + j;
+				for (size_t k = 0; k < ab.size(); k++)
+				{
+					out[k] = (modulus) ? (out[k] + ab[k]) % modulus : out[k] + ab[k];
+				}
+			}
+		}
+	}
+
+	void multiplyModulo(const PolynomialInteger& p1, const PolynomialInteger& p2, PolynomialInteger& outResult)
+	{
+		if (p1.size() == 0 || p2.size() == 0)
+		{
+			outResult.resize(0);
+			return;
+		}
+
+		size_t resultSize = p1.size() + p2.size() - 1;
+		if (resultSize > MaxSize)
+		{
+			multiplyBlocks(p1, p2, multiplyModulo, Prime1, outResult);
+			return;
+		}
+		size_t n = powerOfTwo(resultSize);
+		std::vector<uint32_t> a(n), b(n), r(resultSize);
+		convolve<Prime1>(p1, p2, n, a, b, r);
+
+		outResult.resize(resultSize);
+		for (size_t i = 0; i < resultSize; i++)
+		{
+			outResult[i] = r[i];
+		}
+	}
+
+	void multiply(const PolynomialInteger& p1, const PolynomialInteger& p2, PolynomialInteger& outResult)
+	{
+		if (p1.size() == 0 || p2.size() == 0)
+		{
+			outResult.resize(0);
+			return;
+		}
+
+		size_t resultSize = p1.size() + p2.size() - 1;
+		if (resultSize > MaxSize)
+		{
+			multiplyBlocks(p1, p2, multiply, 0, outResult);
+			return;
+		}
+
+		// Every limb sum is below 4 * 2^22 * 2^32 = 2^56, the shorter operand has at most 2^22 coefficients,
+		// which is less than Prime1 * Prime2: two residues give it exactly.
+		size_t n = powerOfTwo(resultSize);
+		std::vector<uint32_t> a(Limbs * n), b(Limbs * n);
+		std::vector<uint32_t> r1[Limbs], r2[Limbs];
+		for (size_t s = 0; s < Limbs; s++)
+		{
+			r1[s].resize(resultSize);
+			r2[s].resize(resultSize);
+		}
+		convolveLimbs<Prime1>(p1, p2, n, a, b, r1);
+		convolveLimbs<Prime2>(p1, p2, n, a, b, r2);
+
+		// Garner: sum = x1 + Prime1 * y2, then the sums shifted into place modulo 2^64
+		const uint32_t inv1Mod2 = powMod(Prime1 % Prime2, Prime2 - 2, Prime2);
+		outResult.resize(resultSize);
+		for (size_t i = 0; i < resultSize; i++)
+		{
+			uint64_t c = 0;
+			for (size_t s = 0; s < Limbs; s++)
+			{
+				uint32_t x1 = r1[s][i];
+				uint32_t y2 = mulMod((r2[s][i] + Prime2 - x1 % Prime2) % Prime2, inv1Mod2, Prime2);
+				c += (x1 + (uint64_t) Prime1 * y2) << (16 * s);
+			}
+			outResult[i] = c;
+		}
+	}
+}
+
+void FastMultiply<uint64_t>::multiply(const PolynomialInteger& p1, const PolynomialInteger& p2, PolynomialInteger& outResult)
+{
+	ntt::multiply(p1, p2, outResult);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "polynomial.h"
+
+namespace ntt
+{
+	// NTT friendly primes c * 2^k + 1, both with 3 as primitive root.
+	const uint32_t Prime1 = 998244353; // 119 * 2^23 + 1
+	const uint32_t Prime2 = 167772161; //   5 * 2^25 + 1
+
+	// Number theoretic transform modulo Modulus, the modular counterpart of fft::Plan.
+	// size must be a power of two dividing Modulus - 1. Inverse plans also scale by 1/size.
+	template<uint32_t Modulus>
+	class Plan
+	{
+	public:
+		Plan(size_t size, bool inverse);
+
+		size_t size() const    { return n; }
+		bool   inverse() const { return inv; }
+
+		// data holds residues in [0, Modulus).
+		void execute(uint32_t* data) const;
+
+		static const Plan& get(size_t size, bool inverse);
+
+	private:
+		size_t n;
+		bool inv;
+		uint32_t scale;
+		uint32_t scaleShoup;
+		std::vector<size_t> permutation;
+		std::vector<uint32_t> roots;        // per stage, the stage with half length m at m .. 2m - 1
+		std::vector<uint32_t> rootsShoup;   // floor(root * 2^32 / Modulus), multiplies by a root without a division
+	};
+
+	// Product modulo Prime1, coefficients are reduced first. Products longer than 2^23 are put together from blocks.
+	void multiplyModulo(const PolynomialInteger& p1, const PolynomialInteger& p2, PolynomialInteger& outResult);
+
+	// Product modulo 2^64, the same as multiplyNaive for any coefficients. The coefficients are split into
+	// 16 bit limbs, the limb products computed modulo Prime1 and Prime2 and combined with the CRT, which is
+	// exact for them. Products longer than 2^23 are put together from blocks.
+	void multiply(const PolynomialInteger& p1, const PolynomialInteger& p2, PolynomialInteger& outResult);
+}
@@ -3,47 +3,278 @@
 #include <vector>
 #include <complex>
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include "smallvector.h"
 
+template<typename T, typename Allocator = std::allocator<T> > class TPolynomial;
+template<typename T, typename Allocator = std::allocator<T> > class TPolynomialModulus;
+template<typename E> struct PolyExprStorage;
+
+// Base of the polynomial expression templates (see the operators at the end of the file).
+// E is the concrete node, coefficient(i) is zero past size().
+template<typename T, typename E>
+class PolyExpr
+{
+public:
+	const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// a * b + c for the evaluation loops. The complex overload skips the inf/nan recovery of std::complex
+// multiplication, which otherwise is an out of line call that keeps the loops from vectorizing.
 template<typename T>
-class TPolynomial
+inline T multiplyAdd(const T& a, const T& b, const T& c)
+{
+	return a * b + c;
+}
+
+inline std::complex<double> multiplyAdd(const std::complex<double>& a, const std::complex<double>& b, const std::complex<double>& c)
+{
+	return std::complex<double>(a.real() * b.real() - a.imag() * b.imag() + c.real(), a.real() * b.imag() + a.imag() * b.real() + c.imag());
+}
+
+// 1 / a for the divisions. Integers work modulo 2^64, where every odd a has an inverse.
+template<typename T>
+inline T multiplicativeInverse(const T& a)
+{
+	return T(1) / a;
+}
+
+inline uint64_t multiplicativeInverse(uint64_t a)
+{
+	// Newton for x = 1/a mod 2^64, a * a = 1 mod 8 starts with 3 correct bits, each step doubles them
+	uint64_t x = a;
+	for (int i = 0; i < 5; i++)
+	{
+		x *= 2 - a * x;
+	}
+	return x;
+}
+
+// Operand sizes at which TPolynomial::multiply changes algorithm, measured on the shorter operand.
+// Defaults are conservative, calibrateMultiply() in tuning.h measures them for the current machine.
+struct MultiplyConfig
+{
+	MultiplyConfig() : karatsubaThreshold(32), fftThreshold(256), nttThreshold(32768), divisionThreshold(512) {}
+
+	size_t karatsubaThreshold; // up to this size schoolbook, also the base case of the Karatsuba recursion
+	size_t fftThreshold;       // from this size a floating point transform based multiply
+	size_t nttThreshold;       // from this size the exact NTT multiply of integer polynomials
+	size_t divisionThreshold;  // from this size of quotient and divisor, division by Newton iteration instead of long division
+
+	static MultiplyConfig& current()
+	{
+		static MultiplyConfig config;
+		return config;
+	}
+};
+
+// Transform based multiplication for element types that support it.
+// Specializations are implemented next to their transform.
+template<typename T>
+struct FastMultiply
+{
+	static const bool Available = false;
+	static size_t threshold(const MultiplyConfig&) { return (size_t) -1; }
+	static void multiply(const TPolynomial<T>& p1, const TPolynomial<T>& p2, TPolynomial<T>& outResult) {}
+};
+
+template<>
+struct FastMultiply<double>
+{
+	static const bool Available = true;
+	static size_t threshold(const MultiplyConfig& config) { return config.fftThreshold; }
+	static void multiply(const TPolynomial<double>& p1, const TPolynomial<double>& p2, TPolynomial<double>& outResult);
+};
+
+template<>
+struct FastMultiply< std::complex<double> >
+{
+	static const bool Available = true;
+	static size_t threshold(const MultiplyConfig& config) { return config.fftThreshold; }
+	static void multiply(const TPolynomial< std::complex<double> >& p1, const TPolynomial< std::complex<double> >& p2, TPolynomial< std::complex<double> >& outResult);
+};
+
+template<>
+struct FastMultiply<uint64_t>
+{
+	static const bool Available = true;
+	static size_t threshold(const MultiplyConfig& config) { return config.nttThreshold; }
+	static void multiply(const TPolynomial<uint64_t>& p1, const TPolynomial<uint64_t>& p2, TPolynomial<uint64_t>& outResult);
+};
+
+// Horner across points with one point per vector lane, for the element types that have a kernel
+// (horner.cpp). evaluate returns how many of the leading points it did, 0 without SIMD on this CPU.
+// For one point, real coefficients are split over the lanes instead (evaluate at x, n >= 16), false
+// when there is no kernel.
+template<typename T>
+struct BatchHorner
+{
+	static size_t evaluate(const T*, size_t, const T*, size_t, T*) { return 0; }
+	static bool evaluate(const T*, size_t, const T&, T&) { return false; }
+};
+
+template<>
+struct BatchHorner<double>
+{
+	static size_t evaluate(const double* coefficients, size_t n, const double* xs, size_t count, double* outValues);
+	static bool evaluate(const double* coefficients, size_t n, const double& x, double& outValue);
+};
+
+template<>
+struct BatchHorner< std::complex<double> >
+{
+	static size_t evaluate(const std::complex<double>* coefficients, size_t n, const std::complex<double>* xs, size_t count, std::complex<double>* outValues);
+	static bool evaluate(const std::complex<double>*, size_t, const std::complex<double>&, std::complex<double>&) { return false; }
+};
+
+// Up to InlineCapacity coefficients are stored inside the object, so building low degree polynomials
+// does not allocate. Larger ones take their storage from Allocator.
+template<typename T, typename Allocator>
+class TPolynomial : public PolyExpr< T, TPolynomial<T, Allocator> >
 {
 public:
-	TPolynomial(size_t n) : coefficients(n) {}
+	static const size_t InlineCapacity = 8;
+
+	TPolynomial(size_t n, const Allocator& allocator = Allocator()) : coefficients(n, allocator) {}
+	explicit TPolynomial(const Allocator& allocator) : coefficients(allocator) {}
 	TPolynomial(const TPolynomial& other) : coefficients(other.coefficients) {}
+	TPolynomial(TPolynomial&& other) SMALLVECTOR_NOEXCEPT : coefficients(std::move(other.coefficients)) {}
 	TPolynomial() {}
 	~TPolynomial() {}
 
+	TPolynomial& operator=(const TPolynomial& other)  { coefficients = other.coefficients; return *this; }
+	TPolynomial& operator=(TPolynomial&& other)       { coefficients = std::move(other.coefficients); return *this; }
+
+	// Evaluates a whole expression like a + b*c - d into the result's storage, see the expression templates
+	// at the end of the file. Constructed from an expression, the allocator comes from its polynomials.
+	template<typename E> TPolynomial(const PolyExpr<T, E>& expr);
+	template<typename E> TPolynomial& operator=(const PolyExpr<T, E>& expr)       { assign(expr.self()); return *this; }
+	template<typename E> TPolynomial& operator+=(const PolyExpr<T, E>& expr);
+	template<typename E> TPolynomial& operator-=(const PolyExpr<T, E>& expr);
+	T coefficient(size_t index) const { return (index < coefficients.size()) ? coefficients[index] : T(); }
+
 	      T&   operator[](size_t index)                       { return coefficients[index]; }
 	const T&   operator[](size_t index) const                 { return coefficients[index]; }
 	size_t     size() const                                   { return coefficients.size(); }
 	void       resize(size_t newSize,  const T& defaultValue) { coefficients.resize(newSize, defaultValue); }
 	void       resize(size_t newSize)                         { coefficients.resize(newSize); }
+	void       reserve(size_t newCapacity)                    { coefficients.reserve(newCapacity); }
+	Allocator  allocator() const                              { return coefficients.allocator(); }
+	      T*   data()                                         { return coefficients.data(); }
+	const T*   data() const                                   { return coefficients.data(); }
 
 	T calculate(const T& x) const;
+	// Evaluates at count points, for real and complex coefficients vectorized across the points (BatchHorner).
+	// For many points on a large polynomial multipoint::evaluate (multipoint.h) is asymptotically faster.
+	void calculate(const T* xs, size_t count, T* outValues) const;
 	void add(const TPolynomial& p, TPolynomial& outResult) const;
+	void derivative(TPolynomial& outResult) const;
 	void multiplyNaive(const TPolynomial& p, TPolynomial& outResult) const;
-	void multiplyKaratsuba(const TPolynomial& p, TPolynomial& outResult) const;
+	// Products where the shorter operand has at most threshold coefficients are done by schoolbook multiplication.
+	void multiplyKaratsuba(const TPolynomial& p, TPolynomial& outResult, size_t threshold = MultiplyConfig::current().karatsubaThreshold) const;
+	// Picks schoolbook, Karatsuba or a transform from the operand sizes and MultiplyConfig::current().
+	void multiply(const TPolynomial& p, TPolynomial& outResult) const;
+
+	// Power series inverse: outResult * this = 1 mod x^length, by Newton iteration on top of multiply.
+	// The constant coefficient must be invertible (odd for PolynomialInteger, which works modulo 2^64).
+	// outResult may not be this.
+	void inverse(size_t length, TPolynomial& outResult) const;
+	// this = quotient * divisor + remainder, the remainder has divisor.size() - 1 coefficients.
+	// The last coefficient of divisor must be invertible. Division goes through the inverse of the reversed
+	// divisor, below MultiplyConfig::divisionThreshold by long division.
+	void divmod(const TPolynomial& divisor, TPolynomial& outQuotient, TPolynomial& outRemainder) const;
+	void mod(const TPolynomial& divisor, TPolynomial& outRemainder) const;
 
 private:
-	std::vector<T> coefficients;
+	typedef SmallVector<T, InlineCapacity, Allocator> Storage;
+
+	template<typename E> void assign(const E& expr);
+	template<typename Node> void assign(const Node& expr, std::false_type);
+	template<typename Node> void assign(const Node& expr, std::true_type);
+	void fastMultiply(const TPolynomial& p, TPolynomial& outResult, std::true_type) const;
+	void fastMultiply(const TPolynomial& p, TPolynomial& outResult, std::false_type) const;
+
+	static void longDivide(const TPolynomial& a, const TPolynomial& b, TPolynomial* outQuotient, TPolynomial& outRemainder);
+	static void divide(const TPolynomial& a, const TPolynomial& b, const TPolynomial& reversedInverse, TPolynomial* outQuotient, TPolynomial& outRemainder);
+
+	template<typename, typename> friend class TPolynomialModulus;
+
+	static size_t karatsubaScratch(size_t na, size_t nb, size_t threshold);
+	static void schoolbook(const T* a, size_t na, const T* b, size_t nb, T* out);
+	static void karatsuba(const T* a, size_t na, const T* b, size_t nb, T* out, T* scratch, size_t threshold);
+
+	Storage coefficients;
 };
 
-template<typename T>
-inline T TPolynomial<T>::calculate(const T& x) const
+template<typename T, typename Allocator>
+inline T TPolynomial<T, Allocator>::calculate(const T& x) const
 {
-	T px = 1.0, r = 0.0;
+	size_t n = coefficients.size();
+	if (n == 0)
+	{
+		return T();
+	}
+	if (n < 16)
+	{
+		T r = coefficients[n - 1];
+		for (size_t i = n - 1; i-- > 0;)
+		{
+			r = multiplyAdd(r, x, coefficients[i]);
+		}
+		return r;
+	}
+
+	T value;
+	if (BatchHorner<T>::evaluate(coefficients.data(), n, x, value))
+	{
+		return value;
+	}
 
+	// p(x) = p0(x^4) + x p1(x^4) + x^2 p2(x^4) + x^3 p3(x^4), the four Horner chains are independent
+	// so they overlap in the pipeline instead of each step waiting for the previous multiply
+	T x2 = x * x;
+	T x4 = x2 * x2;
+	size_t blocks = n / 4;
+	T r0 = T(), r1 = T(), r2 = T(), r3 = T();
+	for (size_t i = n; i-- > 4 * blocks;)
+	{
+		// the top n % 4 coefficients go to p0, the block steps shift them up by x^(4 blocks)
+		r0 = multiplyAdd(r0, x, coefficients[i]);
+	}
+	for (size_t b = blocks; b-- > 0;)
+	{
+		const T* c = coefficients.data() + 4 * b;
+		r0 = multiplyAdd(r0, x4, c[0]);
+		r1 = multiplyAdd(r1, x4, c[1]);
+		r2 = multiplyAdd(r2, x4, c[2]);
+		r3 = multiplyAdd(r3, x4, c[3]);
+	}
+	return multiplyAdd(multiplyAdd(multiplyAdd(r3, x, r2), x, r1), x, r0);
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::calculate(const T* xs, size_t count, T* outValues) const
+{
 	size_t n = coefficients.size();
-	for (size_t i = 0; i < n; i++)
+	if (n == 0)
+	{
+		std::fill(outValues, outValues + count, T());
+		return;
+	}
+
+	// the points the kernel leaves, and all of them for types without one, one by one
+	size_t done = BatchHorner<T>::evaluate(coefficients.data(), n, xs, count, outValues);
+	for (size_t k = done; k < count; k++)
 	{
-		r += px * coefficients[i];
-		px *= x;
+		outValues[k] = calculate(xs[k]);
 	}
-	return r;
 }
 
-template<typename T>
-inline void TPolynomial<T>::add(const TPolynomial& other, TPolynomial& outResult) const
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::add(const TPolynomial& other, TPolynomial& outResult) const
 {
 	size_t n = coefficients.size();
 	size_t m = other.coefficients.size();
@@ -56,7 +287,7 @@ inline void TPolynomial<T>::add(const TPolynomial& other, TPolynomial& outResult
 		outResult.coefficients[i] = coefficients[i] + other.coefficients[i];
 	}
 
-	const std::vector<T>* v = &(other.coefficients);
+	const Storage* v = &(other.coefficients);
 	if (n > m)
 	{
 		v = &coefficients;
@@ -64,21 +295,58 @@ inline void TPolynomial<T>::add(const TPolynomial& other, TPolynomial& outResult
 
 	for (size_t i = mn; i < mx; i++)
 	{
-		outResult.coefficients[i] = v->at(mn + i);
+		outResult.coefficients[i] = (*v)[i];
 	}
 }
 
-template<typename T>
-inline void TPolynomial<T>::multiplyNaive(const TPolynomial& other, TPolynomial& outResult) const
+template<typename T, typename Allocator>
+template<typename E>
+inline TPolynomial<T, Allocator>& TPolynomial<T, Allocator>::operator+=(const PolyExpr<T, E>& expr)
+{
+	return *this = *this + expr;
+}
+
+template<typename T, typename Allocator>
+template<typename E>
+inline TPolynomial<T, Allocator>& TPolynomial<T, Allocator>::operator-=(const PolyExpr<T, E>& expr)
+{
+	return *this = *this - expr;
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::derivative(TPolynomial& outResult) const
+{
+	size_t n = coefficients.size();
+	if (n <= 1)
+	{
+		outResult.resize(0);
+		return;
+	}
+
+	TPolynomial r(n - 1, allocator());
+	for (size_t i = 1; i < n; i++)
+	{
+		r[i - 1] = coefficients[i] * T(i);
+	}
+	outResult = std::move(r);
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::multiplyNaive(const TPolynomial& other, TPolynomial& outResult) const
 {
-	const std::vector<T>& p1 = coefficients;
-	const std::vector<T>& p2 = other.coefficients;
-	std::vector<T>& res = outResult.coefficients;
+	const Storage& p1 = coefficients;
+	const Storage& p2 = other.coefficients;
+	Storage& res = outResult.coefficients;
 
 	size_t n1 = p1.size();
 	size_t n2 = p2.size();
+	if (n1 == 0 || n2 == 0)
+	{
+		res.clear();
+		return;
+	}
 
-	res.resize(n1 * n2);
+	res.assign(n1 + n2 - 1, T());
 	for (size_t i = 0; i < n1; i++)
 	{
 		for (size_t j = 0; j < n2; j++)
@@ -88,33 +356,738 @@ inline void TPolynomial<T>::multiplyNaive(const TPolynomial& other, TPolynomial&
 	}
 }
 
-template<typename T>
-inline void TPolynomial<T>::multiplyKaratsuba(const TPolynomial& other, TPolynomial& outResult) const
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::multiplyKaratsuba(const TPolynomial& other, TPolynomial& outResult, size_t threshold) const
 {
-	const std::vector<T>& p1 = coefficients;
-	const std::vector<T>& p2 = other.coefficients;
-	std::vector<T>& res = outResult.coefficients;
+	const Storage& p1 = coefficients;
+	const Storage& p2 = other.coefficients;
+	Storage& res = outResult.coefficients;
 
-	auto karatsuba = [](size_t n, const std::vector<T>& p1, const std::vector<T>& p2)
+	size_t n1 = p1.size();
+	size_t n2 = p2.size();
+	if (n1 == 0 || n2 == 0)
 	{
+		res.clear();
+		return;
+	}
 
-	};
+	// one buffer for the whole recursion, every level takes its slice from the front
+	std::vector<T, Allocator> scratch(karatsubaScratch(n1, n2, std::max<size_t>(threshold, 1)) + 1, T(), coefficients.allocator());
+	res.resize(n1 + n2 - 1);
+	karatsuba(p1.data(), n1, p2.data(), n2, res.data(), scratch.data(), std::max<size_t>(threshold, 1));
+}
 
-	size_t n1 = p1.size();
-	size_t n2 = p2.size();
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::multiply(const TPolynomial& other, TPolynomial& outResult) const
+{
+	const MultiplyConfig& config = MultiplyConfig::current();
+	size_t n = std::min(coefficients.size(), other.coefficients.size());
 
-	res.resize(n1 * n2);
-	for (size_t i = 0; i < n1; i++)
+	if (n <= config.karatsubaThreshold)
 	{
-		for (size_t j = 0; j < n2; j++)
+		multiplyNaive(other, outResult);
+	}
+	else if (FastMultiply<T>::Available && n >= FastMultiply<T>::threshold(config))
+	{
+		fastMultiply(other, outResult, typename std::is_same< Allocator, std::allocator<T> >::type());
+	}
+	else
+	{
+		multiplyKaratsuba(other, outResult, config.karatsubaThreshold);
+	}
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::fastMultiply(const TPolynomial& other, TPolynomial& outResult, std::true_type) const
+{
+	FastMultiply<T>::multiply(*this, other, outResult);
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::fastMultiply(const TPolynomial& other, TPolynomial& outResult, std::false_type) const
+{
+	// the transforms work on default allocated polynomials, at these sizes the copies are cheap next to the multiply
+	TPolynomial<T> a(size()), b(other.size()), r;
+	std::copy(coefficients.begin(), coefficients.end(), a.data());
+	std::copy(other.coefficients.begin(), other.coefficients.end(), b.data());
+	FastMultiply<T>::multiply(a, b, r);
+	outResult.resize(r.size());
+	std::copy(r.data(), r.data() + r.size(), outResult.data());
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::inverse(size_t length, TPolynomial& outResult) const
+{
+	assert(size() > 0 && &outResult != this);
+
+	// g' = g (2 - f g) doubles the number of correct terms
+	outResult.resize(1);
+	outResult[0] = multiplicativeInverse(coefficients[0]);
+
+	TPolynomial head(allocator()), t(allocator()), next(allocator());
+	for (size_t len = 1; len < length;)
+	{
+		len = std::min(2 * len, length);
+		head.resize(std::min(len, size()));
+		std::copy(data(), data() + head.size(), head.data());
+
+		head.multiply(outResult, t);
+		t.resize(len);
+		for (size_t i = 0; i < len; i++)
 		{
-			res[i + j] += (p1[i] * p2[j]);
+			t[i] = T() - t[i];
 		}
+		t[0] += T(2);
+
+		outResult.multiply(t, next);
+		next.resize(len);
+		std::swap(outResult, next);
+	}
+	outResult.resize(length);
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::divmod(const TPolynomial& divisor, TPolynomial& outQuotient, TPolynomial& outRemainder) const
+{
+	TPolynomial reversed(divisor.size(), allocator()), reversedInverse(allocator());
+	if (size() >= divisor.size() && std::min(size() - divisor.size() + 1, divisor.size()) >= MultiplyConfig::current().divisionThreshold)
+	{
+		std::reverse_copy(divisor.data(), divisor.data() + divisor.size(), reversed.data());
+		reversed.inverse(size() - divisor.size() + 1, reversedInverse);
 	}
+	divide(*this, divisor, reversedInverse, &outQuotient, outRemainder);
 }
 
-// we are not really going to work with so many types, just real and complex.
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::mod(const TPolynomial& divisor, TPolynomial& outRemainder) const
+{
+	TPolynomial quotient(allocator());
+	divmod(divisor, quotient, outRemainder);
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::longDivide(const TPolynomial& a, const TPolynomial& b, TPolynomial* outQuotient, TPolynomial& outRemainder)
+{
+	size_t m = b.size() - 1;
+	size_t k = a.size() - m;
+	T leadInverse = multiplicativeInverse(b[m]);
+
+	TPolynomial r(a);
+	if (outQuotient)
+	{
+		outQuotient->resize(k);
+	}
+	for (size_t i = k; i-- > 0;)
+	{
+		T q = r[i + m] * leadInverse;
+		for (size_t j = 0; j <= m; j++)
+		{
+			r[i + j] -= q * b[j];
+		}
+		if (outQuotient)
+		{
+			(*outQuotient)[i] = q;
+		}
+	}
+	r.resize(m);
+	outRemainder = std::move(r);
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::divide(const TPolynomial& a, const TPolynomial& b, const TPolynomial& reversedInverse, TPolynomial* outQuotient, TPolynomial& outRemainder)
+{
+	// reversedInverse holds 1 / reverse(b) to at least size(a) - degree(b) terms, or nothing for long division
+	size_t m = b.size() - 1;
+	if (a.size() <= m)
+	{
+		outRemainder = a;
+		outRemainder.resize(m);
+		if (outQuotient)
+		{
+			outQuotient->resize(0);
+		}
+		return;
+	}
+
+	size_t k = a.size() - m;
+	if (reversedInverse.size() < k)
+	{
+		longDivide(a, b, outQuotient, outRemainder);
+		return;
+	}
+
+	// reverse(q) = reverse(a) / reverse(b) mod x^k
+	TPolynomial ra(k, a.allocator()), inverse(k, a.allocator()), q(a.allocator()), qb(a.allocator());
+	std::reverse_copy(a.data() + m, a.data() + a.size(), ra.data());
+	std::copy(reversedInverse.data(), reversedInverse.data() + k, inverse.data());
+	ra.multiply(inverse, q);
+	q.resize(k);
+	std::reverse(q.data(), q.data() + k);
+
+	// r = a - q b, only the low m coefficients survive
+	q.multiply(b, qb);
+	TPolynomial r(m, a.allocator());
+	for (size_t i = 0; i < m; i++)
+	{
+		r[i] = a[i] - qb[i];
+	}
+	outRemainder = std::move(r);
+	if (outQuotient)
+	{
+		*outQuotient = std::move(q);
+	}
+}
+
+template<typename T, typename Allocator>
+inline size_t TPolynomial<T, Allocator>::karatsubaScratch(size_t na, size_t nb, size_t threshold)
+{
+	if (na < nb)
+	{
+		std::swap(na, nb);
+	}
+	if (nb <= threshold)
+	{
+		return 0;
+	}
+
+	size_t h = (na + 1) / 2;
+	if (nb <= h)
+	{
+		return (2 * nb - 1) + karatsubaScratch(nb, nb, threshold);
+	}
+	return (4 * h - 1) + karatsubaScratch(h, h, threshold);
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::schoolbook(const T* a, size_t na, const T* b, size_t nb, T* out)
+{
+	std::fill(out, out + na + nb - 1, T());
+	for (size_t i = 0; i < na; i++)
+	{
+		for (size_t j = 0; j < nb; j++)
+		{
+			out[i + j] += a[i] * b[j];
+		}
+	}
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomial<T, Allocator>::karatsuba(const T* a, size_t na, const T* b, size_t nb, T* out, T* scratch, size_t threshold)
+{
+	if (na < nb)
+	{
+		std::swap(a, b);
+		std::swap(na, nb);
+	}
+	if (nb <= threshold)
+	{
+		schoolbook(a, na, b, nb, out);
+		return;
+	}
+
+	size_t h = (na + 1) / 2;
+	if (nb <= h)
+	{
+		// unbalanced: multiply b with consecutive nb sized slices of a and add them up
+		T* product = scratch;
+		std::fill(out, out + na + nb - 1, T());
+		for (size_t offset = 0; offset < na; offset += nb)
+		{
+			size_t len = std::min(nb, na - offset);
+			karatsuba(a + offset, len, b, nb, product, scratch + (2 * nb - 1), threshold);
+			for (size_t i = 0; i < len + nb - 1; i++)
+			{
+				out[offset + i] += product[i];
+			}
+		}
+		return;
+	}
+
+	// a = a0 + x^h a1, b = b0 + x^h b1
+	// a*b = z0 + x^h ((a0 + a1)(b0 + b1) - z0 - z2) + x^2h z2
+	size_t na1 = na - h;
+	size_t nb1 = nb - h;
+	T* sa = scratch;
+	T* sb = sa + h;
+	T* z1 = sb + h;
+	T* next = z1 + (2 * h - 1);
+
+	for (size_t i = 0; i < h; i++)
+	{
+		sa[i] = a[i];
+		sb[i] = b[i];
+	}
+	for (size_t i = 0; i < na1; i++) sa[i] += a[h + i];
+	for (size_t i = 0; i < nb1; i++) sb[i] += b[h + i];
+
+	T* z0 = out;
+	T* z2 = out + 2 * h;
+	karatsuba(a, h, b, h, z0, next, threshold);
+	out[2 * h - 1] = T();
+	karatsuba(a + h, na1, b + h, nb1, z2, next, threshold);
+	karatsuba(sa, h, sb, h, z1, next, threshold);
+
+	for (size_t i = 0; i < 2 * h - 1; i++)
+	{
+		z1[i] -= z0[i];
+	}
+	for (size_t i = 0; i < na1 + nb1 - 1; i++)
+	{
+		z1[i] -= z2[i];
+	}
+	for (size_t i = 0; i < 2 * h - 1; i++)
+	{
+		out[h + i] += z1[i];
+	}
+}
+
+// A divisor prepared for repeated reductions, the inverse of the reversed divisor is computed once.
+// Dividends of up to 2 * divisor.size() - 1 coefficients, like the product of two remainders, use the
+// cached inverse, larger ones extend it for that call.
+template<typename T, typename Allocator>
+class TPolynomialModulus
+{
+public:
+	typedef TPolynomial<T, Allocator> Poly;
+
+	TPolynomialModulus() {}
+	TPolynomialModulus(const Poly& divisor);
+
+	const Poly& divisor() const { return d; }
+
+	void divmod(const Poly& a, Poly& outQuotient, Poly& outRemainder) const;
+	void reduce(const Poly& a, Poly& outRemainder) const;
+	// (a * b) mod divisor
+	void multiply(const Poly& a, const Poly& b, Poly& outResult) const;
+
+private:
+	const Poly& inverseFor(const Poly& a, Poly& scratch) const;
+
+	Poly d;
+	Poly reversedInverse;
+};
+
+template<typename T, typename Allocator>
+inline TPolynomialModulus<T, Allocator>::TPolynomialModulus(const Poly& divisor)
+	: d(divisor), reversedInverse(divisor.allocator())
+{
+	if (d.size() >= MultiplyConfig::current().divisionThreshold)
+	{
+		Poly reversed(d.size(), d.allocator());
+		std::reverse_copy(d.data(), d.data() + d.size(), reversed.data());
+		reversed.inverse(d.size(), reversedInverse);
+	}
+}
+
+template<typename T, typename Allocator>
+inline const TPolynomial<T, Allocator>& TPolynomialModulus<T, Allocator>::inverseFor(const Poly& a, Poly& scratch) const
+{
+	size_t k = (a.size() >= d.size()) ? a.size() - d.size() + 1 : 0;
+	if (k <= reversedInverse.size() || std::min(k, d.size()) < MultiplyConfig::current().divisionThreshold)
+	{
+		return reversedInverse;
+	}
+	Poly reversed(d.size(), d.allocator());
+	std::reverse_copy(d.data(), d.data() + d.size(), reversed.data());
+	reversed.inverse(k, scratch);
+	return scratch;
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomialModulus<T, Allocator>::divmod(const Poly& a, Poly& outQuotient, Poly& outRemainder) const
+{
+	Poly scratch(d.allocator());
+	Poly::divide(a, d, inverseFor(a, scratch), &outQuotient, outRemainder);
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomialModulus<T, Allocator>::reduce(const Poly& a, Poly& outRemainder) const
+{
+	Poly scratch(d.allocator());
+	Poly::divide(a, d, inverseFor(a, scratch), 0, outRemainder);
+}
+
+template<typename T, typename Allocator>
+inline void TPolynomialModulus<T, Allocator>::multiply(const Poly& a, const Poly& b, Poly& outResult) const
+{
+	Poly product(d.allocator());
+	a.multiply(b, product);
+	reduce(product, outResult);
+}
+
+// ---- Expression templates ----
+// Nodes keep polynomials by reference (through PolyTerm) and other nodes by value, products included.
+// Expressions without a product are evaluated in one pass per coefficient. In an expression with products
+// the first product is multiplied straight into the destination and the other terms are added to it, so
+// a + b*c - d takes no storage but the result's. Every further product needs one temporary.
+//
+// Besides size() and, without products, coefficient(i), every node has
+//   allocator()                        the allocator of its leftmost polynomial, AllocatorType its type
+//   reads(p)                           whether the polynomial at p is an operand anywhere in the node
+//   firstProduct()                     the leftmost product node outside of product operands, 0 if none
+//   multiplyInto(out, product, f)      out = f * product, the product being one of its nodes
+//   addTo(out, f, skip)                out += f * node without the product skip, out has room for size()
+template<typename E>
+struct PolyExprStorage
+{
+	typedef E type;
+};
+
+template<typename T, typename Allocator>
+class PolyTerm : public PolyExpr< T, PolyTerm<T, Allocator> >
+{
+public:
+	typedef Allocator AllocatorType;
+	static const bool HasProduct = false;
+
+	PolyTerm(const TPolynomial<T, Allocator>& p) : poly(p) {}
+
+	size_t    size() const                 { return poly.size(); }
+	T         coefficient(size_t i) const  { return poly.coefficient(i); }
+	Allocator allocator() const            { return poly.allocator(); }
+	bool      reads(const void* p) const   { return p == &poly; }
+	const void* firstProduct() const       { return 0; }
+	const TPolynomial<T, Allocator>& polynomial() const { return poly; }
+
+	template<typename P> void multiplyInto(P&, const void*, const T&) const {}
+	template<typename P> void addTo(P& out, const T& factor, const void*) const
+	{
+		for (size_t i = 0; i < poly.size(); i++)
+		{
+			out[i] += factor * poly[i];
+		}
+	}
+
+private:
+	const TPolynomial<T, Allocator>& poly;
+};
+
+template<typename T, typename Allocator>
+struct PolyExprStorage< TPolynomial<T, Allocator> >
+{
+	typedef PolyTerm<T, Allocator> type;
+};
+
+// out += factor * node in one pass when the node has no product, through its terms otherwise
+template<typename P, typename T, typename Node>
+inline void addNode(P& out, const Node& node, const T& factor, const void*, std::false_type)
+{
+	for (size_t i = 0; i < node.size(); i++)
+	{
+		out[i] += factor * node.coefficient(i);
+	}
+}
+
+template<typename P, typename T, typename Node>
+inline void addNode(P& out, const Node& node, const T& factor, const void* skip, std::true_type)
+{
+	node.addTo(out, factor, skip);
+}
+
+template<typename P, typename T, typename Node>
+inline void addNode(P& out, const Node& node, const T& factor, const void* skip)
+{
+	addNode(out, node, factor, skip, std::integral_constant<bool, Node::HasProduct>());
+}
+
+// The operands of a product as polynomials of type P: polynomials of that type as they are, anything else
+// evaluated into scratch.
+template<typename T, typename Allocator>
+inline const TPolynomial<T, Allocator>& polyOperand(const PolyTerm<T, Allocator>& node, TPolynomial<T, Allocator>&)
+{
+	return node.polynomial();
+}
+
+template<typename P, typename Node>
+inline const P& polyOperand(const Node& node, P& scratch)
+{
+	scratch = node;
+	return scratch;
+}
+
+template<typename T, typename L, typename R>
+class PolySum : public PolyExpr< T, PolySum<T, L, R> >
+{
+	typedef typename PolyExprStorage<L>::type Left;
+	typedef typename PolyExprStorage<R>::type Right;
+
+public:
+	typedef typename Left::AllocatorType AllocatorType;
+	static const bool HasProduct = Left::HasProduct || Right::HasProduct;
+
+	PolySum(const L& l, const R& r) : left(l), right(r) {}
+
+	size_t        size() const                 { return std::max(left.size(), right.size()); }
+	T             coefficient(size_t i) const  { return left.coefficient(i) + right.coefficient(i); }
+	AllocatorType allocator() const            { return left.allocator(); }
+	bool          reads(const void* p) const   { return left.reads(p) || right.reads(p); }
+	const void*   firstProduct() const         { const void* p = left.firstProduct(); return p ? p : right.firstProduct(); }
+
+	template<typename P> void multiplyInto(P& out, const void* product, const T& factor) const
+	{
+		left.multiplyInto(out, product, factor);
+		right.multiplyInto(out, product, factor);
+	}
+	template<typename P> void addTo(P& out, const T& factor, const void* skip) const
+	{
+		addNode(out, left, factor, skip);
+		addNode(out, right, factor, skip);
+	}
+
+private:
+	const Left left;
+	const Right right;
+};
+
+template<typename T, typename L, typename R>
+class PolyDifference : public PolyExpr< T, PolyDifference<T, L, R> >
+{
+	typedef typename PolyExprStorage<L>::type Left;
+	typedef typename PolyExprStorage<R>::type Right;
+
+public:
+	typedef typename Left::AllocatorType AllocatorType;
+	static const bool HasProduct = Left::HasProduct || Right::HasProduct;
+
+	PolyDifference(const L& l, const R& r) : left(l), right(r) {}
+
+	size_t        size() const                 { return std::max(left.size(), right.size()); }
+	T             coefficient(size_t i) const  { return left.coefficient(i) - right.coefficient(i); }
+	AllocatorType allocator() const            { return left.allocator(); }
+	bool          reads(const void* p) const   { return left.reads(p) || right.reads(p); }
+	const void*   firstProduct() const         { const void* p = left.firstProduct(); return p ? p : right.firstProduct(); }
+
+	template<typename P> void multiplyInto(P& out, const void* product, const T& factor) const
+	{
+		left.multiplyInto(out, product, factor);
+		right.multiplyInto(out, product, T() - factor);
+	}
+	template<typename P> void addTo(P& out, const T& factor, const void* skip) const
+	{
+		addNode(out, left, factor, skip);
+		addNode(out, right, T() - factor, skip);
+	}
+
+private:
+	const Left left;
+	const Right right;
+};
+
+template<typename T, typename E>
+class PolyScaled : public PolyExpr< T, PolyScaled<T, E> >
+{
+	typedef typename PolyExprStorage<E>::type Node;
+
+public:
+	typedef typename Node::AllocatorType AllocatorType;
+	static const bool HasProduct = Node::HasProduct;
+
+	PolyScaled(const T& s, const E& e) : scale(s), expr(e) {}
+
+	size_t        size() const                 { return expr.size(); }
+	T             coefficient(size_t i) const  { return scale * expr.coefficient(i); }
+	AllocatorType allocator() const            { return expr.allocator(); }
+	bool          reads(const void* p) const   { return expr.reads(p); }
+	const void*   firstProduct() const         { return expr.firstProduct(); }
+
+	template<typename P> void multiplyInto(P& out, const void* product, const T& factor) const
+	{
+		expr.multiplyInto(out, product, factor * scale);
+	}
+	template<typename P> void addTo(P& out, const T& factor, const void* skip) const
+	{
+		addNode(out, expr, factor * scale, skip);
+	}
+
+private:
+	T scale;
+	const Node expr;
+};
+
+// Multiplied when the expression is evaluated, through TPolynomial::multiply with polynomials of the
+// allocator type of the left operand.
+template<typename T, typename L, typename R>
+class PolyProduct : public PolyExpr< T, PolyProduct<T, L, R> >
+{
+	typedef typename PolyExprStorage<L>::type Left;
+	typedef typename PolyExprStorage<R>::type Right;
+
+public:
+	typedef typename Left::AllocatorType AllocatorType;
+	typedef TPolynomial<T, AllocatorType> Poly;
+	static const bool HasProduct = true;
+
+	PolyProduct(const L& l, const R& r) : left(l), right(r) {}
+
+	size_t        size() const                 { return (left.size() && right.size()) ? left.size() + right.size() - 1 : 0; }
+	AllocatorType allocator() const            { return left.allocator(); }
+	bool          reads(const void* p) const   { return left.reads(p) || right.reads(p); }
+	const void*   firstProduct() const         { return this; }
+
+	void multiply(Poly& outResult) const
+	{
+		Poly a(allocator()), b(allocator());
+		polyOperand(left, a).multiply(polyOperand(right, b), outResult);
+	}
+
+	void multiplyInto(Poly& out, const void* product, const T& factor) const
+	{
+		if (product != this)
+		{
+			return;
+		}
+		multiply(out);
+		if (factor != T(1))
+		{
+			for (size_t i = 0; i < out.size(); i++)
+			{
+				out[i] *= factor;
+			}
+		}
+	}
+	// a destination of another allocator type gets a copy
+	template<typename P> void multiplyInto(P& out, const void* product, const T& factor) const
+	{
+		if (product != this)
+		{
+			return;
+		}
+		Poly r(allocator());
+		multiplyInto(r, product, factor);
+		out.resize(r.size());
+		std::copy(r.data(), r.data() + r.size(), out.data());
+	}
+	template<typename P> void addTo(P& out, const T& factor, const void* skip) const
+	{
+		if (skip == this)
+		{
+			return;
+		}
+		Poly r(allocator());
+		multiply(r);
+		for (size_t i = 0; i < r.size(); i++)
+		{
+			out[i] += factor * r[i];
+		}
+	}
+
+private:
+	const Left left;
+	const Right right;
+};
+
+template<typename T, typename L, typename R>
+inline PolySum<T, L, R> operator+(const PolyExpr<T, L>& l, const PolyExpr<T, R>& r)
+{
+	return PolySum<T, L, R>(l.self(), r.self());
+}
+
+template<typename T, typename L, typename R>
+inline PolyDifference<T, L, R> operator-(const PolyExpr<T, L>& l, const PolyExpr<T, R>& r)
+{
+	return PolyDifference<T, L, R>(l.self(), r.self());
+}
+
+template<typename T, typename E>
+inline PolyScaled<T, E> operator-(const PolyExpr<T, E>& e)
+{
+	return PolyScaled<T, E>(T(-1), e.self());
+}
+
+template<typename T, typename E>
+inline PolyScaled<T, E> operator*(const T& s, const PolyExpr<T, E>& e)
+{
+	return PolyScaled<T, E>(s, e.self());
+}
+
+template<typename T, typename E>
+inline PolyScaled<T, E> operator*(const PolyExpr<T, E>& e, const T& s)
+{
+	return PolyScaled<T, E>(s, e.self());
+}
+
+template<typename T, typename L, typename R>
+inline PolyProduct<T, L, R> operator*(const PolyExpr<T, L>& l, const PolyExpr<T, R>& r)
+{
+	return PolyProduct<T, L, R>(l.self(), r.self());
+}
+
+// The allocator of an expression for a polynomial of type Allocator, a default one if the types differ
+template<typename Allocator, typename Node>
+inline Allocator exprAllocator(const Node& node, std::true_type)
+{
+	return node.allocator();
+}
+
+template<typename Allocator, typename Node>
+inline Allocator exprAllocator(const Node&, std::false_type)
+{
+	return Allocator();
+}
+
+template<typename Allocator, typename E>
+inline Allocator exprAllocator(const E& expr)
+{
+	typedef typename PolyExprStorage<E>::type Node;
+	return exprAllocator<Allocator>(Node(expr), typename std::is_same<typename Node::AllocatorType, Allocator>::type());
+}
+
+template<typename T, typename Allocator>
+template<typename E>
+inline TPolynomial<T, Allocator>::TPolynomial(const PolyExpr<T, E>& expr)
+	: coefficients(exprAllocator<Allocator>(expr.self()))
+{
+	assign(expr.self());
+}
+
+template<typename T, typename Allocator>
+template<typename E>
+inline void TPolynomial<T, Allocator>::assign(const E& expr)
+{
+	typedef typename PolyExprStorage<E>::type Node;
+	assign(Node(expr), std::integral_constant<bool, Node::HasProduct>());
+}
+
+template<typename T, typename Allocator>
+template<typename Node>
+inline void TPolynomial<T, Allocator>::assign(const Node& expr, std::false_type)
+{
+	// growing first is safe when the expression reads this polynomial: the new coefficients are zero,
+	// and every coefficient only depends on the same index of the operands
+	size_t n = expr.size();
+	coefficients.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		coefficients[i] = expr.coefficient(i);
+	}
+}
+
+template<typename T, typename Allocator>
+template<typename Node>
+inline void TPolynomial<T, Allocator>::assign(const Node& expr, std::true_type)
+{
+	// the product overwrites the result before the other terms are read
+	if (expr.reads(this))
+	{
+		TPolynomial r(allocator());
+		r.assign(expr, std::true_type());
+		*this = std::move(r);
+		return;
+	}
+
+	const void* product = expr.firstProduct();
+	expr.multiplyInto(*this, product, T(1));
+	coefficients.resize(expr.size());
+	expr.addTo(*this, T(1), product);
+}
+
+// we are not really going to work with so many types, just real, complex and exact integer.
 typedef TPolynomial<double>                    Polynomial;
 typedef TPolynomial< std::complex<double> >    PolynomialComplex;
+typedef TPolynomial<uint64_t>                  PolynomialInteger;
+
+typedef TPolynomialModulus<double>                  PolynomialModulus;
+typedef TPolynomialModulus< std::complex<double> >  PolynomialComplexModulus;
+typedef TPolynomialModulus<uint64_t>                PolynomialIntegerModulus;
 
 
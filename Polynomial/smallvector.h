@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+// VS2013 has move semantics but not noexcept.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define SMALLVECTOR_NOEXCEPT
+#else
+#define SMALLVECTOR_NOEXCEPT noexcept
+#endif
+
+// Contiguous growable storage that keeps up to InlineCapacity elements inside the object,
+// only larger sizes are taken from the allocator.
+// Moving a heap backed vector steals the buffer, moving an inline one moves the elements.
+template<typename T, size_t InlineCapacity, typename Allocator = std::allocator<T> >
+class SmallVector
+{
+	static_assert(InlineCapacity > 0, "SmallVector needs room for at least one inline element");
+
+public:
+	explicit SmallVector(const Allocator& allocator = Allocator());
+	SmallVector(size_t n, const Allocator& allocator = Allocator());
+	SmallVector(const SmallVector& other);
+	SmallVector(SmallVector&& other) SMALLVECTOR_NOEXCEPT;
+	~SmallVector() { release(); }
+
+	SmallVector& operator=(const SmallVector& other);
+	SmallVector& operator=(SmallVector&& other);
+
+	      T&   operator[](size_t index)       { return first[index]; }
+	const T&   operator[](size_t index) const { return first[index]; }
+	size_t     size() const                   { return count; }
+	size_t     capacity() const               { return cap; }
+	bool       empty() const                  { return count == 0; }
+	bool       isInline() const               { return first == inlineData(); }
+	      T*   data()                         { return first; }
+	const T*   data() const                   { return first; }
+	      T*   begin()                        { return first; }
+	const T*   begin() const                  { return first; }
+	      T*   end()                          { return first + count; }
+	const T*   end() const                    { return first + count; }
+	Allocator  allocator() const              { return alloc; }
+
+	void resize(size_t newSize);
+	void resize(size_t newSize, const T& value);
+	void reserve(size_t newCapacity);
+	void assign(size_t newSize, const T& value);
+	void clear();
+
+private:
+	typedef std::allocator_traits<Allocator> AllocatorTraits;
+
+	      T* inlineData()       { return reinterpret_cast<T*>(&storage); }
+	const T* inlineData() const { return reinterpret_cast<const T*>(&storage); }
+
+	void grow(size_t newCapacity);
+	void copyFrom(const T* source, size_t n);
+	void release();
+
+	Allocator alloc;
+	T* first;
+	size_t count;
+	size_t cap;
+	typename std::aligned_storage<sizeof(T) * InlineCapacity, std::alignment_of<T>::value>::type storage;
+};
+
+// ---- Inline implementation ----
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline SmallVector<T, InlineCapacity, Allocator>::SmallVector(const Allocator& allocator)
+	: alloc(allocator), first(inlineData()), count(0), cap(InlineCapacity)
+{
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline SmallVector<T, InlineCapacity, Allocator>::SmallVector(size_t n, const Allocator& allocator)
+	: alloc(allocator), first(inlineData()), count(0), cap(InlineCapacity)
+{
+	resize(n);
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline SmallVector<T, InlineCapacity, Allocator>::SmallVector(const SmallVector& other)
+	: alloc(other.alloc), first(inlineData()), count(0), cap(InlineCapacity)
+{
+	copyFrom(other.first, other.count);
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline SmallVector<T, InlineCapacity, Allocator>::SmallVector(SmallVector&& other) SMALLVECTOR_NOEXCEPT
+	: alloc(other.alloc), first(inlineData()), count(0), cap(InlineCapacity)
+{
+	if (other.isInline())
+	{
+		for (size_t i = 0; i < other.count; i++)
+		{
+			new (first + i) T(std::move(other.first[i]));
+		}
+		count = other.count;
+		other.clear();
+	}
+	else
+	{
+		first = other.first;
+		count = other.count;
+		cap = other.cap;
+		other.first = other.inlineData();
+		other.count = 0;
+		other.cap = InlineCapacity;
+	}
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline SmallVector<T, InlineCapacity, Allocator>& SmallVector<T, InlineCapacity, Allocator>::operator=(const SmallVector& other)
+{
+	if (this != &other)
+	{
+		copyFrom(other.first, other.count);
+	}
+	return *this;
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline SmallVector<T, InlineCapacity, Allocator>& SmallVector<T, InlineCapacity, Allocator>::operator=(SmallVector&& other)
+{
+	if (this == &other)
+	{
+		return *this;
+	}
+
+	// the buffer can only change hands when this allocator is able to free it
+	if (!other.isInline() && alloc == other.alloc)
+	{
+		release();
+		first = other.first;
+		count = other.count;
+		cap = other.cap;
+		other.first = other.inlineData();
+		other.count = 0;
+		other.cap = InlineCapacity;
+	}
+	else
+	{
+		clear();
+		reserve(other.count);
+		for (size_t i = 0; i < other.count; i++)
+		{
+			new (first + i) T(std::move(other.first[i]));
+		}
+		count = other.count;
+		other.clear();
+	}
+	return *this;
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline void SmallVector<T, InlineCapacity, Allocator>::resize(size_t newSize)
+{
+	resize(newSize, T());
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline void SmallVector<T, InlineCapacity, Allocator>::resize(size_t newSize, const T& value)
+{
+	// value may be one of the elements, which growing moves away
+	const T fill(value);
+	if (newSize > cap)
+	{
+		grow(std::max(newSize, 2 * cap));
+	}
+	for (size_t i = count; i < newSize; i++)
+	{
+		new (first + i) T(fill);
+	}
+	for (size_t i = newSize; i < count; i++)
+	{
+		first[i].~T();
+	}
+	count = newSize;
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline void SmallVector<T, InlineCapacity, Allocator>::reserve(size_t newCapacity)
+{
+	if (newCapacity > cap)
+	{
+		grow(newCapacity);
+	}
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline void SmallVector<T, InlineCapacity, Allocator>::assign(size_t newSize, const T& value)
+{
+	clear();
+	resize(newSize, value);
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline void SmallVector<T, InlineCapacity, Allocator>::clear()
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		first[i].~T();
+	}
+	count = 0;
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline void SmallVector<T, InlineCapacity, Allocator>::grow(size_t newCapacity)
+{
+	T* buffer = AllocatorTraits::allocate(alloc, newCapacity);
+	for (size_t i = 0; i < count; i++)
+	{
+		new (buffer + i) T(std::move(first[i]));
+		first[i].~T();
+	}
+	if (!isInline())
+	{
+		AllocatorTraits::deallocate(alloc, first, cap);
+	}
+	first = buffer;
+	cap = newCapacity;
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline void SmallVector<T, InlineCapacity, Allocator>::copyFrom(const T* source, size_t n)
+{
+	clear();
+	reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		new (first + i) T(source[i]);
+	}
+	count = n;
+}
+
+template<typename T, size_t InlineCapacity, typename Allocator>
+inline void SmallVector<T, InlineCapacity, Allocator>::release()
+{
+	clear();
+	if (!isInline())
+	{
+		AllocatorTraits::deallocate(alloc, first, cap);
+	}
+	first = inlineData();
+	cap = InlineCapacity;
+}
@@ -0,0 +1,284 @@
+#include "sparse.h"
+#include "cpu.h"
+#include <threadpool.h>
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	bool lessPosition(const Triplet& a, const Triplet& b)
+	{
+		return a.row < b.row || (a.row == b.row && a.column < b.column);
+	}
+
+	// One sorted chunk per thread, rounded up to a power of two, then rounds of pairwise merges in parallel.
+	void parallelSort(std::vector<Triplet>& items)
+	{
+		ThreadPool& pool = ThreadPool::shared();
+		size_t count = items.size();
+		if (pool.size() == 1 || count < (1 << 15))
+		{
+			std::sort(items.begin(), items.end(), lessPosition);
+			return;
+		}
+
+		size_t chunks = 1;
+		while (chunks < pool.size())
+		{
+			chunks *= 2;
+		}
+		std::vector<size_t> bounds(chunks + 1);
+		for (size_t c = 0; c <= chunks; c++)
+		{
+			bounds[c] = c * count / chunks;
+		}
+		pool.parallelFor(0, chunks, 1, [&](size_t first, size_t last)
+		{
+			for (size_t c = first; c < last; c++)
+			{
+				std::sort(items.begin() + bounds[c], items.begin() + bounds[c + 1], lessPosition);
+			}
+		});
+
+		std::vector<Triplet> merged(count);
+		for (size_t width = 1; width < chunks; width *= 2)
+		{
+			pool.parallelFor(0, chunks / (2 * width), 1, [&](size_t first, size_t last)
+			{
+				for (size_t pair = first; pair < last; pair++)
+				{
+					size_t lo = bounds[2 * width * pair], mid = bounds[2 * width * pair + width], hi = bounds[2 * width * (pair + 1)];
+					std::merge(items.begin() + lo, items.begin() + mid, items.begin() + mid, items.begin() + hi, merged.begin() + lo, lessPosition);
+				}
+			});
+			items.swap(merged);
+		}
+	}
+
+	double rowDotScalar(const uint32_t* index, const double* value, size_t count, const double* x)
+	{
+		double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+		size_t p = 0;
+		for (; p + 4 <= count; p += 4)
+		{
+			s0 += value[p] * x[index[p]];
+			s1 += value[p + 1] * x[index[p + 1]];
+			s2 += value[p + 2] * x[index[p + 2]];
+			s3 += value[p + 3] * x[index[p + 3]];
+		}
+		for (; p < count; p++)
+		{
+			s0 += value[p] * x[index[p]];
+		}
+		return (s0 + s1) + (s2 + s3);
+	}
+
+#ifdef CPU_X86
+	// x[index[0..3]], the masked form with an explicit source keeps GCC from warning about the unmasked one
+	CPU_TARGET_AVX2 inline __m256d gather(const double* x, const uint32_t* index)
+	{
+		__m128i i = _mm_loadu_si128(reinterpret_cast<const __m128i*>(index));
+		__m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+		return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), x, i, all, 8);
+	}
+
+	CPU_TARGET_AVX2 double rowDotAvx2(const uint32_t* index, const double* value, size_t count, const double* x)
+	{
+		// x gathered four at a time, two accumulators to overlap the gathers
+		__m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+		size_t p = 0;
+		for (; p + 8 <= count; p += 8)
+		{
+			s0 = _mm256_fmadd_pd(_mm256_loadu_pd(value + p), gather(x, index + p), s0);
+			s1 = _mm256_fmadd_pd(_mm256_loadu_pd(value + p + 4), gather(x, index + p + 4), s1);
+		}
+		if (p + 4 <= count)
+		{
+			s0 = _mm256_fmadd_pd(_mm256_loadu_pd(value + p), gather(x, index + p), s0);
+			p += 4;
+		}
+		s0 = _mm256_add_pd(s0, s1);
+		__m128d h = _mm_add_pd(_mm256_castpd256_pd128(s0), _mm256_extractf128_pd(s0, 1));
+		double s = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+		for (; p < count; p++)
+		{
+			s += value[p] * x[index[p]];
+		}
+		return s;
+	}
+#endif
+
+	typedef double (*RowDot)(const uint32_t*, const double*, size_t, const double*);
+
+	RowDot selectRowDot()
+	{
+#ifdef CPU_X86
+		if (cpu::current() != cpu::Scalar)
+		{
+			return rowDotAvx2;
+		}
+#endif
+		return rowDotScalar;
+	}
+}
+
+SparseMatrix::SparseMatrix(size_t rows, size_t columns, const Triplet* triplets, size_t count)
+	: n(rows), m(columns), offsets(rows + 1, 0)
+{
+	assert(columns <= (size_t) 1 << 31);
+	std::vector<Triplet> sorted(triplets, triplets + count);
+	parallelSort(sorted);
+
+	indices.reserve(count);
+	elements.reserve(count);
+	for (size_t p = 0; p < count; p++)
+	{
+		const Triplet& t = sorted[p];
+		assert(t.row < n && t.column < m);
+		if (p > 0 && t.row == sorted[p - 1].row && t.column == sorted[p - 1].column)
+		{
+			elements.back() += t.value;
+			continue;
+		}
+		indices.push_back((uint32_t) t.column);
+		elements.push_back(t.value);
+		offsets[t.row + 1]++;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		offsets[i + 1] += offsets[i];
+	}
+}
+
+double SparseMatrix::at(size_t i, size_t j) const
+{
+	const uint32_t* first = indices.data() + offsets[i];
+	const uint32_t* last = indices.data() + offsets[i + 1];
+	const uint32_t* found = std::lower_bound(first, last, (uint32_t) j);
+	return (found != last && *found == j) ? elements[found - indices.data()] : 0.0;
+}
+
+void SparseMatrix::toDense(Matrix& outResult) const
+{
+	outResult.resize(n, m);
+	for (size_t i = 0; i < n; i++)
+	{
+		for (size_t p = offsets[i]; p < offsets[i + 1]; p++)
+		{
+			outResult(i, indices[p]) = elements[p];
+		}
+	}
+}
+
+void SparseMatrix::transpose(SparseMatrix& outResult) const
+{
+	assert(&outResult != this);
+
+	// counting sort on the column, walking the rows in order leaves every new row sorted
+	outResult.n = m;
+	outResult.m = n;
+	outResult.offsets.assign(m + 1, 0);
+	outResult.indices.resize(elements.size());
+	outResult.elements.resize(elements.size());
+	for (size_t p = 0; p < indices.size(); p++)
+	{
+		outResult.offsets[indices[p] + 1]++;
+	}
+	for (size_t j = 0; j < m; j++)
+	{
+		outResult.offsets[j + 1] += outResult.offsets[j];
+	}
+	std::vector<size_t> next(outResult.offsets.begin(), outResult.offsets.end() - 1);
+	for (size_t i = 0; i < n; i++)
+	{
+		for (size_t p = offsets[i]; p < offsets[i + 1]; p++)
+		{
+			size_t q = next[indices[p]]++;
+			outResult.indices[q] = (uint32_t) i;
+			outResult.elements[q] = elements[p];
+		}
+	}
+}
+
+void SparseMatrix::multiply(const double* x, double* outY) const
+{
+	RowDot rowDot = selectRowDot();
+	auto rowRange = [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			size_t begin = offsets[i];
+			outY[i] = rowDot(indices.data() + begin, elements.data() + begin, offsets[i + 1] - begin, x);
+		}
+	};
+
+	ThreadPool& pool = ThreadPool::shared();
+	size_t count = elements.size();
+	if (pool.size() == 1 || count < (1 << 16))
+	{
+		rowRange(0, n);
+		return;
+	}
+
+	// chunk c starts at the first row past c / chunks of the entries, so dense rows do not pile up in one chunk
+	size_t chunks = 4 * pool.size();
+	std::vector<size_t> bounds(chunks + 1);
+	for (size_t c = 0; c < chunks; c++)
+	{
+		bounds[c] = std::upper_bound(offsets.begin(), offsets.end() - 1, c * count / chunks) - offsets.begin() - 1;
+	}
+	bounds[0] = 0;
+	bounds[chunks] = n;
+	pool.parallelFor(0, chunks, 1, [&](size_t first, size_t last)
+	{
+		for (size_t c = first; c < last; c++)
+		{
+			rowRange(bounds[c], bounds[c + 1]);
+		}
+	});
+}
+
+void SparseMatrix::multiplyTransposed(const double* x, double* outY) const
+{
+	auto scatter = [&](size_t first, size_t last, double* y)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			double xi = x[i];
+			for (size_t p = offsets[i]; p < offsets[i + 1]; p++)
+			{
+				y[indices[p]] += elements[p] * xi;
+			}
+		}
+	};
+
+	std::fill(outY, outY + m, 0.0);
+	ThreadPool& pool = ThreadPool::shared();
+	if (pool.size() == 1 || elements.size() < (1 << 16))
+	{
+		scatter(0, n, outY);
+		return;
+	}
+
+	// the first chunk goes straight into outY, the others into their own buffers summed afterwards
+	size_t chunks = pool.size();
+	std::vector<double> partial((chunks - 1) * m, 0.0);
+	pool.parallelFor(0, chunks, 1, [&](size_t first, size_t last)
+	{
+		for (size_t c = first; c < last; c++)
+		{
+			scatter(c * n / chunks, (c + 1) * n / chunks, c == 0 ? outY : partial.data() + (c - 1) * m);
+		}
+	});
+	pool.parallelFor(0, m, 4096, [&](size_t first, size_t last)
+	{
+		for (size_t c = 1; c < chunks; c++)
+		{
+			const double* p = partial.data() + (c - 1) * m;
+			for (size_t j = first; j < last; j++)
+			{
+				outY[j] += p[j];
+			}
+		}
+	});
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "matrix.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Entry of a matrix in coordinate form.
+struct Triplet
+{
+	size_t row;
+	size_t column;
+	double value;
+};
+
+// Compressed sparse row matrix: the entries of row i are rowOffsets()[i] .. rowOffsets()[i + 1] of the index
+// and value arrays, ordered by column. The compressed column form of a matrix is the row form of its transpose,
+// see transpose(). Column indices are 32 bit since the products stream them, below 2^31 for the vector gathers.
+class SparseMatrix
+{
+public:
+	SparseMatrix() : n(0), m(0), offsets(1, 0) {}
+	// From triplets in any order, entries at the same position are summed. The triplets are sorted by a
+	// parallel merge sort on ThreadPool::shared().
+	SparseMatrix(size_t rows, size_t columns, const Triplet* triplets, size_t count);
+
+	size_t          rows() const            { return n; }
+	size_t          columns() const         { return m; }
+	size_t          nonZeros() const        { return elements.size(); }
+	const size_t*   rowOffsets() const      { return offsets.data(); }
+	const uint32_t* columnIndices() const   { return indices.data(); }
+	const double*   values() const          { return elements.data(); }
+
+	// Stored value at (i, j), 0 for none.
+	double at(size_t i, size_t j) const;
+	void toDense(Matrix& outResult) const;
+	void transpose(SparseMatrix& outResult) const;
+
+	// y = this * x, rows split over the shared pool in chunks of about the same number of entries.
+	void multiply(const double* x, double* outY) const;
+	// y = this^T * x. Every chunk of rows scatters into its own copy of y and the copies are summed,
+	// for many products with one matrix multiplying its transpose() saves that.
+	void multiplyTransposed(const double* x, double* outY) const;
+
+private:
+	size_t n;
+	size_t m;
+	std::vector<size_t> offsets;
+	std::vector<uint32_t> indices;
+	std::vector<double> elements;
+};
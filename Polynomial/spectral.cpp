@@ -0,0 +1,113 @@
+#include "spectral.h"
+#include <cassert>
+
+namespace fft
+{
+	namespace
+	{
+		// even and a valid half size, like the padding of fft::multiply
+		size_t spectralSize(size_t capacity)
+		{
+			return 2 * fastSize((std::max<size_t>(capacity, 2) + 1) / 2);
+		}
+	}
+
+	SpectralPolynomial::SpectralPolynomial(size_t capacity)
+		: plan(&RealPlan::get(spectralSize(capacity))), len(0), spectrum(plan->bins()), cacheValid(true)
+	{
+	}
+
+	SpectralPolynomial::SpectralPolynomial(const Polynomial& p, size_t capacity)
+		: plan(&RealPlan::get(spectralSize(std::max(capacity, p.size())))), len(0), spectrum(plan->bins()), cacheValid(false)
+	{
+		assign(p);
+	}
+
+	void SpectralPolynomial::assign(const Polynomial& p)
+	{
+		assert(p.size() <= capacity());
+		plan->direct(p.data(), p.size(), spectrum.data());
+		len = p.size();
+		cache = p;
+		cacheValid = true;
+	}
+
+	SpectralPolynomial& SpectralPolynomial::operator+=(const SpectralPolynomial& other)
+	{
+		assert(other.capacity() == capacity());
+		for (size_t k = 0; k < spectrum.size(); k++)
+		{
+			spectrum[k] += other.spectrum[k];
+		}
+		len = std::max(len, other.len);
+		cacheValid = false;
+		return *this;
+	}
+
+	SpectralPolynomial& SpectralPolynomial::operator-=(const SpectralPolynomial& other)
+	{
+		assert(other.capacity() == capacity());
+		for (size_t k = 0; k < spectrum.size(); k++)
+		{
+			spectrum[k] -= other.spectrum[k];
+		}
+		len = std::max(len, other.len);
+		cacheValid = false;
+		return *this;
+	}
+
+	SpectralPolynomial& SpectralPolynomial::operator*=(const SpectralPolynomial& other)
+	{
+		assert(other.capacity() == capacity());
+		if (len == 0 || other.len == 0)
+		{
+			std::fill(spectrum.data(), spectrum.data() + spectrum.size(), std::complex<double>());
+			len = 0;
+		}
+		else
+		{
+			assert(len + other.len - 1 <= capacity());
+			for (size_t k = 0; k < spectrum.size(); k++)
+			{
+				spectrum[k] = multiplyAdd(spectrum[k], other.spectrum[k], std::complex<double>());
+			}
+			len = len + other.len - 1;
+		}
+		cacheValid = false;
+		return *this;
+	}
+
+	void SpectralPolynomial::multiply(const Polynomial& p, Polynomial& outResult) const
+	{
+		if (len == 0 || p.size() == 0)
+		{
+			outResult.resize(0);
+			return;
+		}
+
+		size_t resultSize = len + p.size() - 1;
+		assert(resultSize <= capacity());
+		PolynomialComplex product(plan->bins());
+		plan->direct(p.data(), p.size(), product.data());
+		for (size_t k = 0; k < product.size(); k++)
+		{
+			product[k] = multiplyAdd(product[k], spectrum[k], std::complex<double>());
+		}
+
+		outResult.resize(capacity());
+		plan->inverse(product.data(), outResult.data());
+		outResult.resize(resultSize);
+	}
+
+	const Polynomial& SpectralPolynomial::coefficients() const
+	{
+		if (!cacheValid)
+		{
+			cache.resize(capacity());
+			plan->inverse(spectrum.data(), cache.data());
+			cache.resize(len);
+			cacheValid = true;
+		}
+		return cache;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "fft.h"
+
+namespace fft
+{
+	// A real polynomial kept as its transform of a fixed size, for chains of products against the same
+	// operands without transforming them again. Products and sums work on the spectrum, coefficients are
+	// only recomputed when asked for. The transform is cyclic: every result must fit in capacity()
+	// coefficients, which the operations check.
+	class SpectralPolynomial
+	{
+	public:
+		// Zero polynomial, enough room for results of up to capacity coefficients.
+		SpectralPolynomial(size_t capacity);
+		SpectralPolynomial(const Polynomial& p, size_t capacity);
+
+		size_t capacity() const { return plan->size(); }
+		// Number of coefficients of the represented polynomial.
+		size_t length() const   { return len; }
+
+		void assign(const Polynomial& p);
+
+		SpectralPolynomial& operator+=(const SpectralPolynomial& other);
+		SpectralPolynomial& operator-=(const SpectralPolynomial& other);
+		SpectralPolynomial& operator*=(const SpectralPolynomial& other);
+
+		// this * p without keeping the spectrum of p: one forward and one inverse transform.
+		void multiply(const Polynomial& p, Polynomial& outResult) const;
+
+		// Coefficients, transformed back on the first call after a change. Not safe to call
+		// concurrently with itself while the cached value is stale.
+		const Polynomial& coefficients() const;
+
+	private:
+		const RealPlan* plan;
+		size_t len;
+		PolynomialComplex spectrum;
+		mutable Polynomial cache;
+		mutable bool cacheValid;
+	};
+}
@@ -0,0 +1,181 @@
+#include "tuning.h"
+#include "fft.h"
+#include "ntt.h"
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+	// Average seconds per call, repeating the call until the measurement is long enough to trust.
+	template<typename F>
+	double timePerCall(F f)
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+		const double MinDuration = 0.002;
+
+		size_t repeat = 1;
+		for (;;)
+		{
+			Clock::time_point start = Clock::now();
+			for (size_t i = 0; i < repeat; i++)
+			{
+				f();
+			}
+			double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			if (elapsed >= MinDuration)
+			{
+				return elapsed / repeat;
+			}
+			repeat *= 2;
+		}
+	}
+
+	void randomPolynomial(size_t n, Polynomial& outPolynomial)
+	{
+		outPolynomial.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			outPolynomial[i] = 0.00001 * std::rand();
+		}
+	}
+
+	void randomPolynomial(size_t n, PolynomialInteger& outPolynomial)
+	{
+		outPolynomial.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			outPolynomial[i] = ((uint64_t) std::rand() << 40) ^ ((uint64_t) std::rand() << 20) ^ std::rand();
+		}
+	}
+}
+
+MultiplyConfig calibrateMultiply()
+{
+	const size_t sizes[] = { 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048 };
+	const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+
+	MultiplyConfig config;
+	Polynomial p1, p2, r;
+
+	// Karatsuba: the first size where one split beats schoolbook, everything below stays schoolbook
+	config.karatsubaThreshold = sizes[count - 1];
+	for (size_t s = 1; s < count; s++)
+	{
+		size_t n = sizes[s];
+		randomPolynomial(n, p1);
+		randomPolynomial(n, p2);
+		double naive = timePerCall([&]() { p1.multiplyNaive(p2, r); });
+		double split = timePerCall([&]() { p1.multiplyKaratsuba(p2, r, n - 1); });
+		if (split < naive)
+		{
+			config.karatsubaThreshold = sizes[s - 1];
+			break;
+		}
+	}
+
+	// FFT: the first size where it beats the tuned Karatsuba
+	config.fftThreshold = sizes[count - 1];
+	for (size_t s = 0; s < count; s++)
+	{
+		size_t n = sizes[s];
+		if (n <= config.karatsubaThreshold)
+		{
+			continue;
+		}
+		randomPolynomial(n, p1);
+		randomPolynomial(n, p2);
+		double karatsuba = timePerCall([&]() { p1.multiplyKaratsuba(p2, r, config.karatsubaThreshold); });
+		double transform = timePerCall([&]() { fft::multiply(p1, p2, r); });
+		if (transform < karatsuba)
+		{
+			config.fftThreshold = n;
+			break;
+		}
+	}
+
+	// NTT: the same against Karatsuba on integer polynomials. The exact product takes 24 integer transforms
+	// where the floating point one takes 3, so this is much further up
+	const size_t integerSizes[] = { 1024, 2048, 4096, 8192, 16384, 32768, 65536 };
+	const size_t integerCount = sizeof(integerSizes) / sizeof(integerSizes[0]);
+	PolynomialInteger i1, i2, ir;
+	config.nttThreshold = integerSizes[integerCount - 1];
+	for (size_t s = 0; s < integerCount; s++)
+	{
+		size_t n = integerSizes[s];
+		randomPolynomial(n, i1);
+		randomPolynomial(n, i2);
+		double karatsuba = timePerCall([&]() { i1.multiplyKaratsuba(i2, ir, config.karatsubaThreshold); });
+		double transform = timePerCall([&]() { ntt::multiply(i1, i2, ir); });
+		if (transform < karatsuba)
+		{
+			config.nttThreshold = n;
+			break;
+		}
+	}
+
+	// Newton division: the first size where it beats long division, with the multiply thresholds found above.
+	// divmod reads the thresholds from the current config
+	MultiplyConfig saved = MultiplyConfig::current();
+	MultiplyConfig::current() = config;
+	config.divisionThreshold = sizes[count - 1];
+	Polynomial q;
+	for (size_t s = 0; s < count; s++)
+	{
+		size_t n = sizes[s];
+		randomPolynomial(2 * n, p1);
+		randomPolynomial(n, p2);
+		p2[n - 1] += 1.0;
+		MultiplyConfig::current().divisionThreshold = (size_t) -1;
+		double longDivision = timePerCall([&]() { p1.divmod(p2, q, r); });
+		MultiplyConfig::current().divisionThreshold = 0;
+		double newton = timePerCall([&]() { p1.divmod(p2, q, r); });
+		if (newton < longDivision)
+		{
+			config.divisionThreshold = n;
+			break;
+		}
+	}
+	MultiplyConfig::current() = saved;
+
+	return config;
+}
+
+bool loadMultiplyConfig(std::istream& in, MultiplyConfig& outConfig)
+{
+	std::string name;
+	size_t value;
+	bool any = false;
+	while (in >> name >> value)
+	{
+		if (name == "karatsubaThreshold")
+		{
+			outConfig.karatsubaThreshold = value;
+			any = true;
+		}
+		else if (name == "fftThreshold")
+		{
+			outConfig.fftThreshold = value;
+			any = true;
+		}
+		else if (name == "nttThreshold")
+		{
+			outConfig.nttThreshold = value;
+			any = true;
+		}
+		else if (name == "divisionThreshold")
+		{
+			outConfig.divisionThreshold = value;
+			any = true;
+		}
+	}
+	return any;
+}
+
+void saveMultiplyConfig(const MultiplyConfig& config, std::ostream& out)
+{
+	out << "karatsubaThreshold " << config.karatsubaThreshold << std::endl;
+	out << "fftThreshold " << config.fftThreshold << std::endl;
+	out << "nttThreshold " << config.nttThreshold << std::endl;
+	out << "divisionThreshold " << config.divisionThreshold << std::endl;
+}
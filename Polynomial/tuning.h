@@ -0,0 +1,13 @@
+#pragma once
+
+#include "polynomial.h"
+#include <iostream>
+
+// Times schoolbook, Karatsuba and FFT multiplication and long against Newton division of random
+// Polynomials, and Karatsuba against the NTT on PolynomialInteger, on this machine and returns the sizes where
+// each algorithm starts to win. Takes a second or two.
+MultiplyConfig calibrateMultiply();
+
+// Plain text config, one "name value" pair per line. Unknown names are ignored.
+bool loadMultiplyConfig(std::istream& in, MultiplyConfig& outConfig);
+void saveMultiplyConfig(const MultiplyConfig& config, std::ostream& out);
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads. The thread calling parallelFor works too, so a pool of size 1 has no
+// workers and runs everything inline. Waiting threads run queued jobs, so nested parallelFor calls are fine.
+class ThreadPool
+{
+public:
+	ThreadPool(size_t threadCount);
+	~ThreadPool();
+
+	size_t size() const { return workers.size() + 1; }
+
+	// Calls f(chunkBegin, chunkEnd) over [begin, end) in chunks of at least grain elements, returns when all are done.
+	void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f);
+
+	// Pool shared by the library, std::thread::hardware_concurrency() threads unless set otherwise.
+	// setThreadCount must not be called while the shared pool is running jobs.
+	static ThreadPool& shared();
+	static void setThreadCount(size_t threadCount);
+
+private:
+	ThreadPool(const ThreadPool&);
+	void operator=(const ThreadPool&);
+
+	bool runOne(std::unique_lock<std::mutex>& lock);
+	void work();
+
+	std::vector<std::thread> workers;
+	std::deque< std::function<void()> > jobs;
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool stopping;
+
+	static std::unique_ptr<ThreadPool>& sharedInstance();
+};
+
+// ---- Inline implementation ----
+inline ThreadPool::ThreadPool(size_t threadCount) : stopping(false)
+{
+	for (size_t i = 1; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::work, this));
+	}
+}
+
+inline ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+
+inline bool ThreadPool::runOne(std::unique_lock<std::mutex>& lock)
+{
+	if (jobs.empty())
+	{
+		return false;
+	}
+	std::function<void()> job = jobs.front();
+	jobs.pop_front();
+	lock.unlock();
+	job();
+	lock.lock();
+	return true;
+}
+
+inline void ThreadPool::work()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping)
+	{
+		if (!runOne(lock))
+		{
+			changed.wait(lock);
+		}
+	}
+}
+
+inline void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	size_t count = end - begin;
+	size_t chunks = std::min(size() * 4, (count + std::max<size_t>(grain, 1) - 1) / std::max<size_t>(grain, 1));
+	if (chunks <= 1 || workers.empty())
+	{
+		f(begin, end);
+		return;
+	}
+
+	std::atomic<size_t> remaining(chunks);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t c = 0; c < chunks; c++)
+		{
+			size_t b = begin + count * c / chunks;
+			size_t e = begin + count * (c + 1) / chunks;
+			jobs.push_back([&f, &remaining, this, b, e]()
+			{
+				f(b, e);
+				if (--remaining == 0)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					changed.notify_all();
+				}
+			});
+		}
+	}
+	changed.notify_all();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (remaining > 0)
+	{
+		if (!runOne(lock))
+		{
+			changed.wait(lock);
+		}
+	}
+}
+
+inline std::unique_ptr<ThreadPool>& ThreadPool::sharedInstance()
+{
+	static std::unique_ptr<ThreadPool> pool;
+	return pool;
+}
+
+inline ThreadPool& ThreadPool::shared()
+{
+	static std::mutex sharedMutex;
+	std::lock_guard<std::mutex> lock(sharedMutex);
+	std::unique_ptr<ThreadPool>& pool = sharedInstance();
+	if (!pool)
+	{
+		pool.reset(new ThreadPool(std::max<unsigned>(std::thread::hardware_concurrency(), 1)));
+	}
+	return *pool;
+}
+
+inline void ThreadPool::setThreadCount(size_t threadCount)
+{
+	ThreadPool& current = shared();
+	if (current.size() != std::max<size_t>(threadCount, 1))
+	{
+		sharedInstance().reset(new ThreadPool(std::max<size_t>(threadCount, 1)));
+	}
+}